@@ -0,0 +1,239 @@
+#pragma once
+
+#include <erebus-gui/erebus-gui.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+
+namespace Erc
+{
+
+//
+// thread pool shared by the client and all plugins for background work,
+// so the number of threads doesn't grow with the number of connections
+//
+
+struct IExecutor
+{
+    using Task = std::function<void()>;
+
+    // may be called from any thread, including the executor's own
+    virtual void post(Task&& task) = 0;
+    virtual unsigned concurrency() const noexcept = 0;
+
+    // where in its period the next periodic job should run, as a fraction of the period;
+    // successive calls are spread evenly so that jobs of different hosts don't fire together
+    virtual double phase() noexcept = 0;
+
+protected:
+    virtual ~IExecutor() {}
+};
+
+
+//
+// serial queue on top of an executor: its tasks run one at a time, in order,
+// on whatever executor thread is free
+//
+
+class Strand final
+    : public Er::NonCopyable
+{
+public:
+    ~Strand()
+    {
+        close();
+    }
+
+    explicit Strand(IExecutor* executor) noexcept
+        : m_executor(executor)
+    {
+    }
+
+    // false once closed
+    bool post(IExecutor::Task&& task)
+    {
+        {
+            std::lock_guard l(m_mutex);
+            if (m_closed)
+                return false;
+
+            m_queue.push_back(std::move(task));
+            if (m_scheduled)
+                return true;
+
+            m_scheduled = true;
+        }
+
+        m_executor->post([this]() { run(); });
+        return true;
+    }
+
+    // drops the tasks that haven't started and waits for the running one
+    void close()
+    {
+        std::unique_lock l(m_mutex);
+        m_closed = true;
+        m_queue.clear();
+        m_idle.wait(l, [this]() { return !m_scheduled; });
+    }
+
+private:
+    void run()
+    {
+        // one task per turn so that a busy strand doesn't keep an executor thread to itself
+        IExecutor::Task task;
+        {
+            std::lock_guard l(m_mutex);
+            if (!next(task))
+                return;
+        }
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            // tasks are expected to handle their own errors
+        }
+
+        {
+            std::lock_guard l(m_mutex);
+            if (m_queue.empty())
+            {
+                m_scheduled = false;
+                m_idle.notify_all();
+                return; // 'this' may be gone as soon as the lock is released
+            }
+        }
+
+        m_executor->post([this]() { run(); });
+    }
+
+    bool next(IExecutor::Task& task)
+    {
+        if (m_queue.empty())
+        {
+            m_scheduled = false;
+            m_idle.notify_all();
+            return false;
+        }
+
+        task = std::move(m_queue.front());
+        m_queue.pop_front();
+        return true;
+    }
+
+    IExecutor* const m_executor;
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::deque<IExecutor::Task> m_queue;
+    bool m_scheduled = false; // run() is queued or running
+    bool m_closed = false;
+};
+
+
+//
+// caps how many of its tasks run on an executor at once; the rest wait in
+// its own queue without taking an executor thread
+//
+// Tasks of one connection are mostly blocking RPCs, so every connection puts
+// them through a limiter of its own and a slow host can't occupy the whole pool.
+// Unlike Strand it never drops tasks: it waits for all of them when destroyed.
+//
+
+class Limiter final
+    : public IExecutor
+    , public Er::NonCopyable
+{
+public:
+    ~Limiter()
+    {
+        std::unique_lock l(m_mutex);
+        m_idle.wait(l, [this]() { return !m_running && m_queue.empty(); });
+    }
+
+    explicit Limiter(IExecutor* executor, unsigned width) noexcept
+        : m_executor(executor)
+        , m_width(std::max(width, 1U))
+    {
+    }
+
+    void post(Task&& task) override
+    {
+        {
+            std::lock_guard l(m_mutex);
+            m_queue.push_back(std::move(task));
+            if (m_running >= m_width)
+                return; // picked up by a running one when it's done
+
+            ++m_running;
+        }
+
+        m_executor->post([this]() { run(); });
+    }
+
+    unsigned concurrency() const noexcept override
+    {
+        return m_width;
+    }
+
+    double phase() noexcept override
+    {
+        return m_executor->phase();
+    }
+
+private:
+    void run()
+    {
+        // one task per turn, like Strand
+        Task task;
+        {
+            std::lock_guard l(m_mutex);
+            if (m_queue.empty())
+            {
+                --m_running;
+                m_idle.notify_all();
+                return;
+            }
+
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            // tasks are expected to handle their own errors
+        }
+
+        {
+            std::lock_guard l(m_mutex);
+            if (m_queue.empty())
+            {
+                --m_running;
+                m_idle.notify_all();
+                return; // 'this' may be gone as soon as the lock is released
+            }
+        }
+
+        m_executor->post([this]() { run(); });
+    }
+
+    IExecutor* const m_executor;
+    const unsigned m_width;
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::deque<Task> m_queue;
+    unsigned m_running = 0; // run() calls queued or running
+};
+
+
+} // namespace Erc {}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <erebus-gui/erebus-gui.hpp>
+
+#include <functional>
+
+#include <QShowEvent>
+#include <QWidget>
+
+
+namespace Erc
+{
+
+namespace Ui
+{
+
+//
+// empty tab page that stands in for the real one until it's first shown;
+// 'activate' is then called once to fill it in
+//
+
+class LazyPage final
+    : public QWidget
+{
+public:
+    explicit LazyPage(std::function<void()>&& activate, QWidget* parent = nullptr)
+        : QWidget(parent)
+        , m_activate(std::move(activate))
+    {
+    }
+
+    bool activated() const noexcept
+    {
+        return !m_activate;
+    }
+
+protected:
+    void showEvent(QShowEvent* event) override
+    {
+        QWidget::showEvent(event);
+
+        if (m_activate)
+        {
+            auto activate = std::move(m_activate);
+            m_activate = nullptr;
+            activate();
+        }
+    }
+
+private:
+    std::function<void()> m_activate;
+};
+
+
+} // namespace Ui {}
+
+} // namespace Erc {}
@@ -2,6 +2,7 @@
 
 #include <erebus-clt/erebus-clt.hxx>
 #include <erebus-gui/erebus-gui.hpp>
+#include <erebus-gui/executor.hpp>
 #include <erebus-gui/settings.hpp>
 #include <erebus/idisposable.hxx>
 #include <erebus/log.hxx>
@@ -21,6 +22,8 @@ struct PluginParams
     QTabWidget* tabWidget = nullptr;
     QMenuBar* mainMenu = nullptr;
     QStatusBar* statusBar = nullptr;
+    IExecutor* executor = nullptr; // for all background work; owned by the client
+    bool lazyActivation = false; // add placeholder tabs and do the heavy work when they are first shown
 
     constexpr PluginParams() noexcept = default;
 
@@ -29,13 +32,17 @@ struct PluginParams
         Er::Log::ILog* log,
         QTabWidget* tabWidget,
         QMenuBar* mainMenu,
-        QStatusBar* statusBar
+        QStatusBar* statusBar,
+        IExecutor* executor,
+        bool lazyActivation = false
     )
         : settings(settings)
         , log(log)
         , tabWidget(tabWidget)
         , mainMenu(mainMenu)
         , statusBar(statusBar)
+        , executor(executor)
+        , lazyActivation(lazyActivation)
     {
     }
 };
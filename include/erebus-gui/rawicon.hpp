@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <QByteArray>
+#include <QImage>
+
+
+namespace Erc
+{
+
+//
+// Raw icon format
+//
+// A 16-byte header followed by premultiplied ARGB32 pixels (QImage's
+// Format_ARGB32_Premultiplied, i.e. native-endian 0xAARRGGBB words),
+// 'stride' bytes per row. Consumers wrap it into a QImage as is, with no
+// decoding; it's bigger than PNG but costs nothing to load at 16-32px.
+// Written by erebus-iconcache, read by whoever gets the icon bytes.
+//
+
+namespace RawIcon
+{
+
+constexpr std::string_view Extension = ".argb";
+constexpr uint32_t Magic = 0x57415245; // 'ERAW'
+constexpr uint32_t FormatArgb32Premultiplied = 1;
+
+struct Header
+{
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+    uint32_t stride; // bytes per row
+    uint32_t format;
+};
+
+static_assert(sizeof(Header) == 16);
+
+
+inline QByteArray encode(const QImage& source)
+{
+    if (source.isNull() || (source.width() > 0xffff) || (source.height() > 0xffff))
+        return QByteArray();
+
+    auto image = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    Header h = { Magic, uint16_t(image.width()), uint16_t(image.height()), uint32_t(image.width()) * 4, FormatArgb32Premultiplied };
+
+    QByteArray bytes;
+    bytes.resize(qsizetype(sizeof(h) + std::size_t(h.stride) * h.height));
+    std::memcpy(bytes.data(), &h, sizeof(h));
+
+    // QImage rows may be padded; ours are not
+    for (int y = 0; y < image.height(); ++y)
+        std::memcpy(bytes.data() + sizeof(h) + std::size_t(h.stride) * y, image.constScanLine(y), h.stride);
+
+    return bytes;
+}
+
+// the returned image refers to 'data' which must outlive it (or call QImage::copy());
+// 'data' must be 4-byte aligned, otherwise the pixels are copied
+inline QImage wrap(const char* data, std::size_t length)
+{
+    Header h;
+    if (length < sizeof(h))
+        return QImage();
+
+    std::memcpy(&h, data, sizeof(h));
+    if ((h.magic != Magic) || (h.format != FormatArgb32Premultiplied) || (h.stride < uint32_t(h.width) * 4))
+        return QImage();
+
+    if (length < sizeof(h) + std::size_t(h.stride) * h.height)
+        return QImage();
+
+    auto pixels = reinterpret_cast<const uchar*>(data + sizeof(h));
+    if ((reinterpret_cast<std::uintptr_t>(pixels) % 4) == 0)
+        return QImage(pixels, h.width, h.height, qsizetype(h.stride), QImage::Format_ARGB32_Premultiplied);
+
+    QImage image(h.width, h.height, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < h.height; ++y)
+        std::memcpy(image.scanLine(y), pixels + std::size_t(h.stride) * y, std::size_t(h.width) * 4);
+
+    return image;
+}
+
+} // namespace RawIcon {}
+
+} // namespace Erc {}
@@ -1,6 +1,7 @@
 #include "application.hpp"
 #include "appsettings.hpp"
 #include "client-version.h"
+#include "filelogsink.hpp"
 #include "mainwindow/mainwindow.hpp"
 #include "settings.hpp"
 
@@ -14,6 +15,8 @@
 #include <filesystem>
 #include <sstream>
 
+#include <QStandardPaths>
+
 
 #if defined(_MSC_VER) && ER_DEBUG
 #include <crtdbg.h>
@@ -141,6 +144,8 @@ bool Application::initialize(int argc, char** argv) noexcept
             Er::System::CurrentThread::setName("main");
             Er::Client::initialize(log());
 
+            m_executor = std::make_unique<Executor>(log(), Erc::Option<unsigned>::get(m_settings.get(), Erp::Client::AppSettings::Application::executorThreads, Erp::Client::AppSettings::Application::executorThreadsDefault));
+
             return true;
         }))
     {
@@ -154,6 +159,7 @@ bool Application::initialize(int argc, char** argv) noexcept
 
 void Application::finalize() noexcept
 {
+    m_executor.reset();
     Er::Client::finalize();
     ::qInstallMessageHandler(nullptr);
     finalizeRtl();
@@ -165,8 +171,9 @@ bool Application::initializeRtl() noexcept
     {
         m_logger = Er::Log::makeAsyncLogger();
 
-        auto logLevel = static_cast<Er::Log::Level>(Erc::Option<int>::get(m_settings.get(), Erp::Client::AppSettings::Log::level, int(Erp::Client::AppSettings::Log::defaultLevel)));
-        m_logger->setLevel(logLevel);
+        // the log view keeps everything and only hides lines, so the logger passes Debug on;
+        // every other sink filters by the configured level itself
+        m_logger->setLevel(Er::Log::Level::Debug);
 
         addLoggers();
 
@@ -184,17 +191,52 @@ bool Application::initializeRtl() noexcept
 
 void Application::addLoggers()
 {
+    auto level = static_cast<Er::Log::Level>(Erc::Option<int>::get(m_settings.get(), Erp::Client::AppSettings::Log::level, int(Erp::Client::AppSettings::Log::defaultLevel)));
+
 #if ER_WINDOWS
-    if (::IsDebuggerPresent())
+    if (::IsDebuggerPresent() && (level < Er::Log::Level::Off))
     {
         auto debugger = Er::Log::makeDebuggerSink(
             Er::Log::SimpleFormatter::make({ Er::Log::SimpleFormatter::Option::Time, Er::Log::SimpleFormatter::Option::Level, Er::Log::SimpleFormatter::Option::Tid }),
-            Er::Log::SimpleFilter::make(Er::Log::Level::Debug, Er::Log::Level::Fatal)
+            Er::Log::SimpleFilter::make(level, Er::Log::Level::Fatal)
         );
 
         m_logger->addSink("debugger", debugger);
     }
 #endif
+
+    if (Erc::Option<bool>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileEnabled, Erp::Client::AppSettings::Log::fileEnabledDefault))
+    {
+        try
+        {
+            FileLogSink::Options options;
+
+            auto dir = Erc::Option<QString>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileDir, QString());
+            if (dir.isEmpty())
+                dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + QLatin1String("/logs");
+            options.dir = std::filesystem::path(dir.toStdU16String());
+
+            options.maxFileSize = uint64_t(Erc::Option<unsigned>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileMaxSize, Erp::Client::AppSettings::Log::fileMaxSizeDefault)) * 1024;
+            options.maxFiles = Erc::Option<unsigned>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileMaxCount, Erp::Client::AppSettings::Log::fileMaxCountDefault);
+            options.syncInterval = std::chrono::milliseconds(Erc::Option<unsigned>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileSyncInterval, Erp::Client::AppSettings::Log::fileSyncIntervalDefault));
+            options.level = static_cast<Er::Log::Level>(Erc::Option<int>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileLevel, int(level)));
+
+            auto compression = Erc::Option<QString>::get(m_settings.get(), Erp::Client::AppSettings::Log::fileCompression, QString::fromUtf8(Erp::Client::AppSettings::Log::fileCompressionDefault)).toLower();
+            if (compression == QLatin1String("zstd"))
+                options.compression = FileLogSink::Compression::Zstd;
+            else if (compression == QLatin1String("gzip"))
+                options.compression = FileLogSink::Compression::Gzip;
+            else
+                options.compression = FileLogSink::Compression::None;
+
+            m_logger->addSink("file", std::make_shared<FileLogSink>(options));
+        }
+        catch (std::exception& e)
+        {
+            // the client still works without it
+            qWarning() << "Failed to create the log file sink: " << e.what() << "\n";
+        }
+    }
 }
 
 void Application::finalizeRtl() noexcept
@@ -218,7 +260,7 @@ int Application::run(int argc, char** argv) noexcept
         log(),
         [this, &result]()
         {
-            Erp::Client::Ui::MainWindow w(log(), settings());
+            Erp::Client::Ui::MainWindow w(log(), settings(), executor());
             result = exec();
         });
 
@@ -2,6 +2,7 @@
 
 #include <erebus/log.hxx>
 
+#include "executor.hpp"
 #include "settings.hpp"
 
 #include <QApplication>
@@ -40,6 +41,12 @@ public:
         return m_logger.get();
     }
 
+    Erc::IExecutor* executor() noexcept
+    {
+        Q_ASSERT(m_executor);
+        return m_executor.get();
+    }
+
     int run(int argc, char** argv) noexcept;
 
 private:
@@ -58,6 +65,7 @@ private:
 
     std::unique_ptr<Settings> m_settings;
     Er::Log::ILog::Ptr m_logger;
+    std::unique_ptr<Executor> m_executor;
 };
 
 } // namespace Erp::Client {}
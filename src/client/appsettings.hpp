@@ -16,9 +16,28 @@ namespace AppSettings
 namespace Log
 {
 
-constexpr std::string_view level("logger/mode");
+constexpr std::string_view level("logger/mode"); // what the log view shows and the other sinks write; the view keeps everything
 constexpr Er::Log::Level defaultLevel = Er::Log::Level::Debug;
 
+constexpr std::string_view fileEnabled("logger/file_enabled");
+constexpr bool fileEnabledDefault = true;
+
+constexpr std::string_view fileLevel("logger/file_level"); // defaults to 'level'
+
+constexpr std::string_view fileDir("logger/file_dir"); // empty means 'logs' in the app data dir
+
+constexpr std::string_view fileMaxSize("logger/file_max_size"); // KB
+constexpr unsigned fileMaxSizeDefault = 8 * 1024;
+
+constexpr std::string_view fileMaxCount("logger/file_max_count");
+constexpr unsigned fileMaxCountDefault = 8;
+
+constexpr std::string_view fileCompression("logger/file_compression"); // 'none', 'gzip' or 'zstd'
+constexpr std::string_view fileCompressionDefault("gzip");
+
+constexpr std::string_view fileSyncInterval("logger/file_sync_interval"); // msec; 0 means after every batch
+constexpr unsigned fileSyncIntervalDefault = 1000;
+
 
 } // namespace Log {}
 
@@ -31,6 +50,12 @@ constexpr bool singleInstanceDefault = true;
 constexpr std::string_view lastPluginDir("application/last_plugin_dir");
 constexpr std::string_view pluginList("application/plugin_list");
 
+constexpr std::string_view executorThreads("application/executor_threads");
+constexpr unsigned executorThreadsDefault = 0; // one per CPU
+
+constexpr std::string_view lazyPlugins("application/lazy_plugins");
+constexpr bool lazyPluginsDefault = true;
+
 } // Application {}
 
 namespace MainWindow
@@ -65,6 +90,10 @@ constexpr std::string_view lastCertificate("connections/certificate");
 constexpr std::string_view lastKey("connections/key");
 constexpr size_t kMaxRecentConnections = 16;
 
+constexpr std::string_view openConnections("connections/open_connections"); // connected at exit, with their SSL settings; see packEndpointSettings()
+constexpr std::string_view reconnectOnStart("connections/reconnect_on_start");
+constexpr bool reconnectOnStartDefault = true;
+
 } // namespace Connections {}
 
     
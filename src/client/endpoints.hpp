@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -81,6 +82,70 @@ private:
 };
 
 
+// an endpoint and the credential files it was connected with, so that it can be reconnected
+struct EndpointSettings
+{
+    std::string endpoint;
+    bool ssl = false;
+    std::string rootCA;
+    std::string certificate;
+    std::string key;
+};
+
+// one endpoint per line, its fields tab-separated
+inline std::string packEndpointSettings(const std::vector<EndpointSettings>& list)
+{
+    std::ostringstream ss;
+    bool first = true;
+    for (auto& s : list)
+    {
+        if (!first)
+            ss << "\n";
+        else
+            first = false;
+
+        ss << s.endpoint << "\t" << (s.ssl ? "1" : "0") << "\t" << s.rootCA << "\t" << s.certificate << "\t" << s.key;
+    }
+
+    return ss.str();
+}
+
+// older versions stored just 'endpoint;endpoint;...'; those endpoints get 'defaults'
+inline std::vector<EndpointSettings> unpackEndpointSettings(const std::string& packed, const EndpointSettings& defaults)
+{
+    std::vector<EndpointSettings> list;
+    if (packed.empty())
+        return list;
+
+    if (packed.find_first_of("\t\n") == std::string::npos)
+    {
+        std::vector<std::string> endpoints;
+        boost::split(endpoints, packed, [](char c) { return (c == ';'); });
+        for (auto& endpoint : endpoints)
+        {
+            auto s = defaults;
+            s.endpoint = endpoint;
+            list.push_back(std::move(s));
+        }
+
+        return list;
+    }
+
+    std::vector<std::string> lines;
+    boost::split(lines, packed, [](char c) { return (c == '\n'); });
+    for (auto& line : lines)
+    {
+        std::vector<std::string> fields;
+        boost::split(fields, line, [](char c) { return (c == '\t'); });
+        fields.resize(5);
+
+        list.push_back(EndpointSettings{ fields[0], (fields[1] == "1"), fields[2], fields[3], fields[4] });
+    }
+
+    return list;
+}
+
+
 
 } // namespace Client {}
 
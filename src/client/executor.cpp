@@ -0,0 +1,158 @@
+#include "executor.hpp"
+
+#include <erebus/system/thread.hxx>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace Erp
+{
+
+namespace Client
+{
+
+namespace
+{
+
+// the executor and the index of the current thread in it, if it's an executor thread
+thread_local const Executor* t_executor = nullptr;
+thread_local unsigned t_index = 0;
+
+} // namespace {}
+
+
+Executor::~Executor()
+{
+    for (auto& t : m_threads)
+        t.request_stop();
+
+    m_threads.clear();
+
+    Er::Log::debug(m_log, "Executor stopped");
+}
+
+Executor::Executor(Er::Log::ILog* log, unsigned threads)
+    : m_log(log)
+{
+    if (!threads)
+        threads = std::max(std::thread::hardware_concurrency(), MinThreads);
+
+    m_queues.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back([this, i](std::stop_token stop) { run(stop, i); });
+
+    Er::Log::info(m_log, "Executor started with {} threads", threads);
+}
+
+unsigned Executor::concurrency() const noexcept
+{
+    return unsigned(m_queues.size());
+}
+
+double Executor::phase() noexcept
+{
+    // golden ratio steps fill [0, 1) evenly however many are taken
+    auto k = m_phases.fetch_add(1, std::memory_order_relaxed);
+    return std::fmod(double(k) * 0.6180339887498949, 1.0);
+}
+
+void Executor::post(Task&& task)
+{
+    auto index = (t_executor == this) ? t_index : (m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size());
+
+    // counted before it can be taken, so that the count never goes below zero
+    m_queued.fetch_add(1, std::memory_order_release);
+
+    try
+    {
+        auto& q = *m_queues[index];
+        std::lock_guard l(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+    catch (...)
+    {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        throw;
+    }
+
+    // so that the wakeup can't slip in between a thread's check and its wait
+    {
+        std::lock_guard l(m_sleepMutex);
+    }
+
+    m_wake.notify_one();
+}
+
+bool Executor::take(unsigned index, Task& task) noexcept
+{
+    {
+        auto& own = *m_queues[index];
+        std::lock_guard l(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (std::size_t i = 1; i < m_queues.size(); ++i)
+    {
+        auto& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard l(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Executor::run(std::stop_token stop, unsigned index) noexcept
+{
+    Er::System::CurrentThread::setName("executor");
+
+    t_executor = this;
+    t_index = index;
+
+    while (!stop.stop_requested())
+    {
+        Task task;
+        if (take(index, task))
+        {
+            m_queued.fetch_sub(1, std::memory_order_acq_rel);
+
+            try
+            {
+                task();
+            }
+            catch (std::exception& e)
+            {
+                Er::Log::error(m_log, "Unexpected exception in a background task: {}", e.what());
+            }
+            catch (...)
+            {
+                Er::Log::error(m_log, "Unexpected exception in a background task");
+            }
+
+            continue;
+        }
+
+        std::unique_lock l(m_sleepMutex);
+        m_wake.wait(l, stop, [this]() { return m_queued.load(std::memory_order_acquire) > 0; });
+    }
+
+    t_executor = nullptr;
+}
+
+} // namespace Client {}
+
+} // namespace Erp {}
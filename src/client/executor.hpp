@@ -0,0 +1,67 @@
+#pragma once
+
+#include <erebus/log.hxx>
+#include <erebus-gui/executor.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace Client
+{
+
+//
+// work-stealing thread pool behind Erc::IExecutor
+//
+// Every thread has its own queue. Tasks posted from an executor thread go to
+// its own queue, others are dealt out round-robin. A thread runs its own tasks
+// oldest first, and when it runs out it takes the newest ones from the others
+// before going to sleep. Tasks left when the executor is destroyed are dropped;
+// whoever posted them (see Erc::Strand) must have waited for them by then.
+//
+
+class Executor final
+    : public Erc::IExecutor
+    , public Er::NonCopyable
+{
+public:
+    ~Executor();
+    explicit Executor(Er::Log::ILog* log, unsigned threads = 0); // 0 means one per CPU, at least MinThreads
+
+    void post(Task&& task) override;
+    unsigned concurrency() const noexcept override;
+    double phase() noexcept override;
+
+    static constexpr unsigned MinThreads = 4; // tasks mostly wait for RPCs
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(std::stop_token stop, unsigned index) noexcept;
+    bool take(unsigned index, Task& task) noexcept;
+
+    Er::Log::ILog* const m_log;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<unsigned> m_next = 0;     // round-robin for posts from outside
+    std::atomic<std::size_t> m_queued = 0; // may briefly count a task that isn't in its queue yet
+    std::mutex m_sleepMutex;
+    std::condition_variable_any m_wake;
+    std::atomic<uint64_t> m_phases = 0;
+    std::vector<std::jthread> m_threads;
+};
+
+} // namespace Client {}
+
+} // namespace Erp {}
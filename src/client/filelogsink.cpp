@@ -0,0 +1,351 @@
+#include "filelogsink.hpp"
+
+#include <erebus/system/thread.hxx>
+
+#include <algorithm>
+#include <ctime>
+
+#include <boost/iostreams/filter/gzip.hpp>
+#if ER_HAVE_BOOST_ZSTD
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
+
+#if ER_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace Erp
+{
+
+namespace Client
+{
+
+namespace
+{
+
+// how long to wait before retrying a log file that couldn't be created
+constexpr std::chrono::seconds ReopenDelay = std::chrono::seconds(10);
+
+const char* levelMark(Er::Log::Level level) noexcept
+{
+    switch (level)
+    {
+    case Er::Log::Level::Debug: return "D";
+    case Er::Log::Level::Info: return "I";
+    case Er::Log::Level::Warning: return "W";
+    case Er::Log::Level::Error: return "E";
+    case Er::Log::Level::Fatal: return "!";
+    default: return "?";
+    }
+}
+
+const char* extension(FileLogSink::Compression compression) noexcept
+{
+    switch (compression)
+    {
+    case FileLogSink::Compression::Gzip: return ".log.gz";
+    case FileLogSink::Compression::Zstd: return ".log.zst";
+    default: return ".log";
+    }
+}
+
+FileLogSink::Options supported(FileLogSink::Options options) noexcept
+{
+#if !ER_HAVE_BOOST_ZSTD
+    // this Boost.Iostreams was built without zstd
+    if (options.compression == FileLogSink::Compression::Zstd)
+        options.compression = FileLogSink::Compression::Gzip;
+#endif
+
+    return options;
+}
+
+} // namespace {}
+
+
+std::streamsize FileLogSink::FileDevice::write(const char* s, std::streamsize n)
+{
+    // a short write means the disk is full or gone; the stream keeps what wasn't
+    // written in its buffer and goes bad if it can't get rid of it
+    auto count = std::fwrite(s, 1, std::size_t(n), file);
+    if (count < std::size_t(n))
+        std::clearerr(file);
+
+    *written += uint64_t(count);
+    return std::streamsize(count);
+}
+
+FileLogSink::~FileLogSink()
+{
+    {
+        std::lock_guard l(m_mutex);
+        m_stop.store(true, std::memory_order_release);
+    }
+
+    m_cv.notify_one();
+
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
+FileLogSink::FileLogSink(const Options& options)
+    : m_options(supported(options))
+    , m_ring(options.capacity)
+{
+    m_writer = std::thread([this]() { run(); });
+}
+
+void FileLogSink::write(Er::Log::Record::Ptr r)
+{
+    if (!r || (r->level < m_options.level))
+        return;
+
+    if (!m_ring.push(std::move(r)))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    wake();
+}
+
+void FileLogSink::flush()
+{
+    // doesn't wait for the disk; the destructor writes out everything that's left
+    m_syncRequested.store(true, std::memory_order_relaxed);
+    wake();
+}
+
+void FileLogSink::wake() noexcept
+{
+    // one notification per batch instead of one per record; a nudge lost to the race
+    // with the writer going to sleep only delays the batch until its wait times out
+    if (!m_pending.exchange(true, std::memory_order_acq_rel))
+        m_cv.notify_one();
+}
+
+void FileLogSink::run() noexcept
+{
+    Er::System::CurrentThread::setName("log_file");
+
+    try
+    {
+        rotate();
+
+        for (;;)
+        {
+            auto written = drain();
+
+            auto dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped && m_file)
+                put("*** " + std::to_string(dropped) + " log records dropped ***\n");
+
+            auto now = Clock::now();
+            auto syncRequested = m_syncRequested.exchange(false, std::memory_order_relaxed);
+            if (m_file)
+            {
+                if (m_dirty && (syncRequested || (now - m_lastSync >= m_options.syncInterval)))
+                    sync();
+
+                if (m_fileSize >= m_options.maxFileSize)
+                    rotate();
+            }
+            else if (now - m_lastOpenAttempt >= ReopenDelay)
+            {
+                open();
+            }
+
+            // the ring has more
+            if (written >= MaxBatch)
+                continue;
+
+            if (m_stop.load(std::memory_order_acquire))
+                break;
+
+            auto timeout = IdleWait;
+            if (m_dirty)
+                timeout = std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(m_lastSync + m_options.syncInterval - now), std::chrono::milliseconds(0), IdleWait);
+
+            std::unique_lock l(m_mutex);
+            m_cv.wait_for(l, timeout, [this]() { return m_pending.load(std::memory_order_acquire) || m_stop.load(std::memory_order_acquire); });
+            m_pending.store(false, std::memory_order_release);
+        }
+
+        while (drain() > 0)
+        {
+        }
+
+        close();
+    }
+    catch (std::exception& e)
+    {
+        std::fprintf(stderr, "Log file writer failed: %s\n", e.what());
+    }
+}
+
+std::size_t FileLogSink::drain()
+{
+    std::size_t count = 0;
+    while (count < MaxBatch)
+    {
+        auto r = m_ring.pop();
+        if (!r)
+            break;
+
+        ++count;
+
+        // with no file there's nowhere to put them
+        if (m_file)
+            put(format(**r));
+    }
+
+    return count;
+}
+
+void FileLogSink::put(const std::string& line)
+{
+    if (m_out.empty())
+    {
+        if (m_options.compression == Compression::Gzip)
+            m_out.push(boost::iostreams::gzip_compressor());
+#if ER_HAVE_BOOST_ZSTD
+        else if (m_options.compression == Compression::Zstd)
+            m_out.push(boost::iostreams::zstd_compressor());
+#endif
+
+        m_out.push(FileDevice{ m_file, &m_fileSize });
+    }
+
+    m_out.write(line.data(), std::streamsize(line.size()));
+    m_dirty = true;
+}
+
+bool FileLogSink::open()
+{
+    m_lastOpenAttempt = Clock::now();
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_options.dir, ec);
+
+    auto path = fileName(0, m_options.compression);
+#if ER_WINDOWS
+    m_file = ::_wfopen(path.c_str(), L"wb");
+#else
+    m_file = std::fopen(path.c_str(), "wb");
+#endif
+
+    if (!m_file)
+    {
+        std::fprintf(stderr, "Failed to create log file %s\n", path.string().c_str());
+        return false;
+    }
+
+    m_fileSize = 0;
+    m_lastSync = Clock::now();
+
+    put("*** Log started " + timestamp() + " ***\n");
+
+    return true;
+}
+
+void FileLogSink::sync()
+{
+    if (!m_file)
+        return;
+
+    // finishes the compressed frame so that everything so far can be decompressed;
+    // a failed write left the stream bad, so the next frame starts clean
+    m_out.reset();
+    m_out.clear();
+
+    std::fflush(m_file);
+#if ER_WINDOWS
+    ::_commit(::_fileno(m_file));
+#else
+    ::fsync(::fileno(m_file));
+#endif
+
+    m_dirty = false;
+    m_lastSync = Clock::now();
+}
+
+void FileLogSink::close()
+{
+    if (!m_file)
+        return;
+
+    sync();
+
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+void FileLogSink::rotate()
+{
+    close();
+
+    // files left with another compression setting are rotated too
+    auto maxFiles = std::max(m_options.maxFiles, 1U);
+    for (auto compression : { Compression::None, Compression::Gzip, Compression::Zstd })
+    {
+        std::error_code ec;
+        std::filesystem::remove(fileName(maxFiles - 1, compression), ec);
+
+        for (auto i = maxFiles - 1; i > 0; --i)
+            std::filesystem::rename(fileName(i - 1, compression), fileName(i, compression), ec);
+    }
+
+    open();
+}
+
+std::filesystem::path FileLogSink::fileName(unsigned index, Compression compression) const
+{
+    auto name = m_options.name;
+    if (index > 0)
+        name.append(".").append(std::to_string(index));
+
+    name.append(extension(compression));
+    return m_options.dir / name;
+}
+
+std::string FileLogSink::format(const Er::Log::Record& r)
+{
+    char prefix[64];
+    ::snprintf(prefix,
+        sizeof(prefix),
+        "[%02u:%02u:%02u.%03u @%u %s] ",
+        unsigned(r.time.hour),
+        unsigned(r.time.minute),
+        unsigned(r.time.second),
+        unsigned(r.time.milli),
+        unsigned(r.tid),
+        levelMark(r.level)
+    );
+
+    std::string line(prefix);
+    line.append(r.message);
+    line.push_back('\n');
+    return line;
+}
+
+std::string FileLogSink::timestamp()
+{
+    auto now = std::time(nullptr);
+    std::tm local = {};
+#if ER_WINDOWS
+    ::localtime_s(&local, &now);
+#else
+    ::localtime_r(&now, &local);
+#endif
+
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+    return buffer;
+}
+
+} // namespace Client {}
+
+} // namespace Erp {}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+
+#include <erebus/log.hxx>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/iostreams/filtering_stream.hpp>
+
+
+namespace Erp
+{
+
+namespace Client
+{
+
+//
+// log sink that writes to size-rotated files
+//
+// write() never touches the disk: it puts the record into a bounded ring
+// and nudges a writer thread, which formats records in batches into the
+// current file through an optional streaming gzip or zstd compressor
+// (zstd falls back to gzip unless Boost.Iostreams supports it).
+// Records that don't fit into the ring are dropped and counted.
+//
+// Every sync interval the writer finishes the current compressed frame and
+// fsyncs the file, so a crash loses at most one interval of records. Both
+// gzip and zstd decompress concatenated frames as a single stream.
+//
+// The current file is <name>.log[.gz|.zst]; older ones are <name>.1.log...
+// up to <name>.<maxFiles - 1>.log...; each start begins a new file.
+//
+
+class FileLogSink final
+    : public Er::Log::ISink
+    , public Er::NonCopyable
+{
+public:
+    enum class Compression
+    {
+        None,
+        Gzip,
+        Zstd
+    };
+
+    struct Options
+    {
+        std::filesystem::path dir;
+        std::string name = "erebus";
+        uint64_t maxFileSize = 8 * 1024 * 1024; // bytes on disk, i.e. compressed
+        unsigned maxFiles = 8;                  // including the current one
+        Compression compression = Compression::Gzip;
+        std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000); // 0 syncs after every batch
+        Er::Log::Level level = Er::Log::Level::Debug; // records below it aren't written
+        std::size_t capacity = DefaultCapacity; // records
+    };
+
+    static constexpr std::size_t DefaultCapacity = 16384;
+
+    ~FileLogSink();
+    explicit FileLogSink(const Options& options);
+
+    void write(Er::Log::Record::Ptr r) override;
+    void flush() override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t MaxBatch = 1024; // records
+    static constexpr std::chrono::milliseconds IdleWait = std::chrono::milliseconds(500);
+
+    // the end of the filter chain; counts what actually reaches the file
+    struct FileDevice
+    {
+        using char_type = char;
+        using category = boost::iostreams::sink_tag;
+
+        std::FILE* file;
+        uint64_t* written;
+
+        std::streamsize write(const char* s, std::streamsize n);
+    };
+
+    void wake() noexcept;
+    void run() noexcept;
+    std::size_t drain();
+    void put(const std::string& line);
+    bool open();
+    void close();
+    void sync();
+    void rotate();
+    std::filesystem::path fileName(unsigned index, Compression compression) const;
+    static std::string format(const Er::Log::Record& r);
+    static std::string timestamp();
+
+    const Options m_options;
+    RingBuffer<Er::Log::Record::Ptr> m_ring;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<bool> m_pending = false;  // the writer has been nudged
+    std::atomic<bool> m_syncRequested = false;
+    std::atomic<bool> m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_writer;
+
+    // owned by the writer thread
+    std::FILE* m_file = nullptr;
+    uint64_t m_fileSize = 0;
+    bool m_dirty = false; // written since the last sync
+    Clock::time_point m_lastSync;
+    Clock::time_point m_lastOpenAttempt;
+    boost::iostreams::filtering_ostream m_out;
+};
+
+} // namespace Client {}
+
+} // namespace Erp {}
@@ -0,0 +1,479 @@
+#include "logmodel.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <QBrush>
+#include <QColor>
+
+namespace Erp
+{
+
+namespace Client
+{
+
+namespace Ui
+{
+
+namespace
+{
+
+// so that a single huge message can't push everything else out
+constexpr std::size_t MaxLineLength = 64 * 1024;
+
+inline char lower(char c) noexcept
+{
+    return ((c >= 'A') && (c <= 'Z')) ? char(c - 'A' + 'a') : c;
+}
+
+std::string lower(std::string_view s)
+{
+    std::string result(s);
+    for (auto& c : result)
+        c = lower(c);
+
+    return result;
+}
+
+inline uint32_t trigram(const char* p) noexcept
+{
+    return uint32_t(uint8_t(lower(p[0]))) | (uint32_t(uint8_t(lower(p[1]))) << 8) | (uint32_t(uint8_t(lower(p[2]))) << 16);
+}
+
+// 'needle' is lowercased already
+bool containsNoCase(std::string_view haystack, std::string_view needle) noexcept
+{
+    auto it = std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(), [](char a, char b) { return lower(a) == b; });
+    return (it != haystack.end()) || needle.empty();
+}
+
+const char* levelMark(Er::Log::Level level) noexcept
+{
+    switch (level)
+    {
+    case Er::Log::Level::Debug: return "D";
+    case Er::Log::Level::Info: return "I";
+    case Er::Log::Level::Warning: return "W";
+    case Er::Log::Level::Error: return "E";
+    case Er::Log::Level::Fatal: return "!";
+    default: return "?";
+    }
+}
+
+} // namespace {}
+
+
+LogModel::~LogModel()
+{
+}
+
+LogModel::LogModel(QObject* parent, std::size_t maxLines, std::size_t arenaSize)
+    : QAbstractListModel(parent)
+    , m_entries(std::max<std::size_t>(maxLines, 1))
+    , m_arena(std::max<std::size_t>(arenaSize, MaxLineLength))
+{
+}
+
+uint64_t LogModel::place(uint64_t offset, std::size_t length) const noexcept
+{
+    auto position = offset % m_arena.size();
+    if (position + length > m_arena.size())
+        offset += m_arena.size() - position;
+
+    return offset;
+}
+
+void LogModel::append(const std::vector<Record>& records)
+{
+    std::vector<Line> lines;
+    for (auto& r : records)
+    {
+        std::string_view rest(r.message);
+        do
+        {
+            auto eol = rest.find('\n');
+            auto text = rest.substr(0, eol);
+            rest = (eol == std::string_view::npos) ? std::string_view() : rest.substr(eol + 1);
+
+            if (!text.empty() && (text.back() == '\r'))
+                text.remove_suffix(1);
+
+            lines.push_back(Line{ &r, text.substr(0, MaxLineLength) });
+        }
+        while (!rest.empty());
+    }
+
+    if (lines.empty())
+        return;
+
+    // where the text of every new line goes
+    std::vector<uint64_t> offsets;
+    offsets.reserve(lines.size());
+    auto end = m_arenaEnd;
+    for (auto& line : lines)
+    {
+        auto offset = place(end, line.text.size());
+        offsets.push_back(offset);
+        end = offset + line.text.size();
+    }
+
+    // anything below this offset gets overwritten
+    auto limit = (end > m_arena.size()) ? (end - m_arena.size()) : 0;
+
+    // new lines that don't fit at all
+    std::size_t skip = 0;
+    while ((skip < lines.size()) && ((offsets[skip] < limit) || (lines.size() - skip > m_entries.size())))
+        ++skip;
+
+    auto added = lines.size() - skip;
+
+    // old lines to drop
+    std::size_t evicted = 0;
+    while ((evicted < m_count) && ((entry(m_firstSeq + evicted).offset < limit) || (m_count - evicted + added > m_entries.size())))
+        ++evicted;
+
+    if (evicted)
+    {
+        auto newFirstSeq = m_firstSeq + evicted;
+
+        std::size_t removedRows = evicted;
+        if (m_filtered)
+        {
+            removedRows = 0;
+            while ((removedRows < m_rows.size()) && (m_rows[removedRows] < newFirstSeq))
+                ++removedRows;
+        }
+
+        if (removedRows)
+            beginRemoveRows(QModelIndex(), 0, int(removedRows - 1));
+
+        for (auto seq = m_firstSeq; seq < newFirstSeq; ++seq)
+            unindexLine(seq, entry(seq));
+
+        m_first = (m_first + evicted) % m_entries.size();
+        m_count -= evicted;
+        m_firstSeq = newFirstSeq;
+
+        if (m_filtered)
+            m_rows.erase(m_rows.begin(), m_rows.begin() + std::ptrdiff_t(removedRows));
+
+        if (removedRows)
+            endRemoveRows();
+
+        if (uint32_t(m_firstSeq / BlockLines) - m_prunedBlock >= PruneEvery)
+            pruneTrigrams();
+    }
+
+    if (added)
+    {
+        // without a filter the new lines are new rows right away
+        if (!m_filtered)
+            beginInsertRows(QModelIndex(), int(m_count), int(m_count + added - 1));
+
+        std::vector<uint32_t> newTids;
+        std::vector<Seq> matching;
+        for (auto i = skip; i < lines.size(); ++i)
+        {
+            auto& line = lines[i];
+            if (!line.text.empty())
+                std::memcpy(m_arena.data() + (offsets[i] % m_arena.size()), line.text.data(), line.text.size());
+
+            auto seq = m_firstSeq + m_count;
+            auto& e = m_entries[(m_first + m_count) % m_entries.size()];
+            e = Entry{ offsets[i], uint32_t(line.text.size()), line.record->msecs, line.record->tid, line.record->level };
+            ++m_count;
+
+            indexLine(seq, e, newTids);
+
+            if (m_filtered && matches(seq))
+                matching.push_back(seq);
+        }
+
+        if (!m_filtered)
+        {
+            endInsertRows();
+        }
+        else if (!matching.empty())
+        {
+            beginInsertRows(QModelIndex(), int(m_rows.size()), int(m_rows.size() + matching.size() - 1));
+            m_rows.insert(m_rows.end(), matching.begin(), matching.end());
+            endInsertRows();
+        }
+
+        for (auto tid : newTids)
+            emit tidAdded(tid);
+    }
+
+    m_arenaEnd = end;
+}
+
+void LogModel::indexLine(Seq seq, const Entry& e, std::vector<uint32_t>& newTids)
+{
+    m_byLevel[e.level].push_back(seq);
+
+    auto& byTid = m_byTid[e.tid];
+    if (byTid.empty())
+        newTids.push_back(e.tid);
+    byTid.push_back(seq);
+
+    auto block = uint32_t(seq / BlockLines);
+    auto t = text(e);
+    for (std::size_t i = 0; i + 3 <= t.size(); ++i)
+    {
+        auto& blocks = m_trigrams[trigram(t.data() + i)];
+        if (blocks.empty() || (blocks.back() != block))
+            blocks.push_back(block);
+    }
+}
+
+void LogModel::unindexLine(Seq seq, const Entry& e)
+{
+    // lines go away in the order they came, so they're always at the front of their lists
+    auto level = m_byLevel.find(e.level);
+    if ((level != m_byLevel.end()) && !level->second.empty() && (level->second.front() == seq))
+        level->second.pop_front();
+
+    auto tid = m_byTid.find(e.tid);
+    if ((tid != m_byTid.end()) && !tid->second.empty() && (tid->second.front() == seq))
+    {
+        tid->second.pop_front();
+        if (tid->second.empty())
+            m_byTid.erase(tid);
+    }
+
+    // the trigram index is pruned in bulk; evicted blocks are skipped by queries until then
+}
+
+void LogModel::pruneTrigrams()
+{
+    auto firstBlock = uint32_t(m_firstSeq / BlockLines);
+    for (auto it = m_trigrams.begin(); it != m_trigrams.end(); )
+    {
+        auto& blocks = it->second;
+        blocks.erase(blocks.begin(), std::lower_bound(blocks.begin(), blocks.end(), firstBlock));
+
+        if (blocks.empty())
+        {
+            it = m_trigrams.erase(it);
+        }
+        else
+        {
+            blocks.shrink_to_fit();
+            ++it;
+        }
+    }
+
+    m_prunedBlock = firstBlock;
+}
+
+bool LogModel::matches(Seq seq) const
+{
+    auto& e = entry(seq);
+
+    if (e.level < m_filter.minLevel)
+        return false;
+
+    if (m_filter.tid && (e.tid != *m_filter.tid))
+        return false;
+
+    return m_needle.empty() || containsNoCase(text(e), m_needle);
+}
+
+std::vector<uint32_t> LogModel::candidateBlocks() const
+{
+    // blocks that have every trigram of the needle
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (std::size_t i = 0; i + 3 <= m_needle.size(); ++i)
+    {
+        auto it = m_trigrams.find(trigram(m_needle.data() + i));
+        if (it == m_trigrams.end())
+            return {};
+
+        lists.push_back(&it->second);
+    }
+
+    std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+
+    auto firstBlock = uint32_t(m_firstSeq / BlockLines);
+    std::vector<uint32_t> blocks(std::lower_bound(lists.front()->begin(), lists.front()->end(), firstBlock), lists.front()->end());
+
+    std::vector<uint32_t> next;
+    for (std::size_t i = 1; (i < lists.size()) && !blocks.empty(); ++i)
+    {
+        next.clear();
+        std::set_intersection(blocks.begin(), blocks.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(next));
+        blocks.swap(next);
+    }
+
+    return blocks;
+}
+
+std::vector<LogModel::Seq> LogModel::query() const
+{
+    std::vector<Seq> result;
+    auto end = m_firstSeq + m_count;
+
+    // walk the shortest list of lines that can possibly match and check the rest of the filter on each
+    if (m_filter.tid)
+    {
+        auto it = m_byTid.find(*m_filter.tid);
+        if (it != m_byTid.end())
+        {
+            for (auto seq : it->second)
+            {
+                if (matches(seq))
+                    result.push_back(seq);
+            }
+        }
+    }
+    else if (m_needle.size() >= 3)
+    {
+        for (auto block : candidateBlocks())
+        {
+            auto from = std::max(Seq(block) * BlockLines, m_firstSeq);
+            auto to = std::min((Seq(block) + 1) * BlockLines, end);
+            for (auto seq = from; seq < to; ++seq)
+            {
+                if (matches(seq))
+                    result.push_back(seq);
+            }
+        }
+    }
+    else if (m_filter.minLevel > Er::Log::Level::Debug)
+    {
+        std::vector<Seq> merged;
+        for (auto it = m_byLevel.lower_bound(m_filter.minLevel); it != m_byLevel.end(); ++it)
+        {
+            std::vector<Seq> next;
+            next.reserve(merged.size() + it->second.size());
+            std::merge(merged.begin(), merged.end(), it->second.begin(), it->second.end(), std::back_inserter(next));
+            merged.swap(next);
+        }
+
+        for (auto seq : merged)
+        {
+            if (matches(seq))
+                result.push_back(seq);
+        }
+    }
+    else
+    {
+        for (auto seq = m_firstSeq; seq < end; ++seq)
+        {
+            if (matches(seq))
+                result.push_back(seq);
+        }
+    }
+
+    return result;
+}
+
+void LogModel::setFilter(const Filter& filter)
+{
+    beginResetModel();
+
+    m_filter = filter;
+    m_needle = lower(filter.text);
+    m_filtered = !filter.empty();
+    m_rows.clear();
+
+    if (m_filtered)
+    {
+        auto rows = query();
+        m_rows.assign(rows.begin(), rows.end());
+    }
+
+    endResetModel();
+}
+
+std::vector<uint32_t> LogModel::tids() const
+{
+    std::vector<uint32_t> result;
+    result.reserve(m_byTid.size());
+    for (auto& [tid, lines] : m_byTid)
+        result.push_back(tid);
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void LogModel::clear()
+{
+    beginResetModel();
+    m_first = 0;
+    m_count = 0;
+    m_firstSeq = 0;
+    m_arenaEnd = 0;
+    m_byLevel.clear();
+    m_byTid.clear();
+    m_trigrams.clear();
+    m_prunedBlock = 0;
+    m_rows.clear();
+    endResetModel();
+}
+
+int LogModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return int(m_filtered ? m_rows.size() : m_count);
+}
+
+QString LogModel::format(const Entry& e) const
+{
+    auto ms = e.msecs;
+    char prefix[64];
+    ::snprintf(prefix,
+        sizeof(prefix),
+        "[%02u:%02u:%02u.%03u @%u %s] ",
+        ms / 3600000,
+        (ms / 60000) % 60,
+        (ms / 1000) % 60,
+        ms % 1000,
+        e.tid,
+        levelMark(e.level)
+    );
+
+    auto result = QString::fromUtf8(prefix);
+    auto message = text(e);
+    result.append(QString::fromUtf8(message.data(), qsizetype(message.size())));
+    return result;
+}
+
+QVariant LogModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || (index.row() < 0) || (index.row() >= rowCount(QModelIndex())))
+        return QVariant();
+
+    auto& e = entry(seqOfRow(index.row()));
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return format(e);
+
+    case Qt::ForegroundRole:
+        if (e.level >= Er::Log::Level::Error)
+            return QBrush(QColor(Qt::red));
+        if (e.level == Er::Log::Level::Warning)
+            return QBrush(QColor(Qt::darkYellow));
+        return QVariant();
+
+    case LevelRole:
+        return int(e.level);
+
+    case TidRole:
+        return e.tid;
+    }
+
+    return QVariant();
+}
+
+} // namespace Ui {}
+
+} // namespace Client {}
+
+} // namespace Erp {}
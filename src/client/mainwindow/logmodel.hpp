@@ -0,0 +1,178 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <QAbstractListModel>
+
+
+namespace Erp
+{
+
+namespace Client
+{
+
+namespace Ui
+{
+
+//
+// log lines for LogView, one row each
+//
+// Lines are kept in a fixed-capacity ring of compact entries whose text lives
+// in a fixed-size circular string arena; the oldest lines are dropped when
+// either is full. Appending is O(1) per line and memory use doesn't depend on
+// how long the client has been running. Row text is formatted on demand.
+//
+// Every line is kept regardless of the filter. Lines are numbered in the order
+// they arrive, and the numbers are indexed by level, by thread and by the
+// trigrams of the text (per block of lines), so changing the filter only walks
+// the lines that may match.
+//
+
+class LogModel final
+    : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    // what LogView's sink hands over to the GUI thread
+    struct Record
+    {
+        uint32_t msecs = 0; // since midnight
+        uint32_t tid = 0;
+        Er::Log::Level level = Er::Log::Level::Info;
+        std::string message;
+
+        Record() = default;
+
+        Record(uint32_t msecs, uint32_t tid, Er::Log::Level level, std::string&& message)
+            : msecs(msecs)
+            , tid(tid)
+            , level(level)
+            , message(std::move(message))
+        {}
+    };
+
+    struct Filter
+    {
+        Er::Log::Level minLevel = Er::Log::Level::Debug;
+        std::optional<uint32_t> tid;
+        std::string text; // case-insensitive (for ASCII) substring
+
+        bool empty() const noexcept
+        {
+            return (minLevel <= Er::Log::Level::Debug) && !tid && text.empty();
+        }
+    };
+
+    enum Role
+    {
+        LevelRole = Qt::UserRole,
+        TidRole
+    };
+
+    static constexpr std::size_t DefaultMaxLines = 256 * 1024;
+    static constexpr std::size_t DefaultArenaSize = 32 * 1024 * 1024; // bytes
+
+    ~LogModel();
+    explicit LogModel(QObject* parent, std::size_t maxLines = DefaultMaxLines, std::size_t arenaSize = DefaultArenaSize);
+
+    // multi-line messages become several rows
+    void append(const std::vector<Record>& records);
+    void clear();
+
+    void setFilter(const Filter& filter);
+
+    const Filter& filter() const noexcept
+    {
+        return m_filter;
+    }
+
+    // threads that have lines in the model
+    std::vector<uint32_t> tids() const;
+
+    int rowCount(const QModelIndex& parent) const override;
+    QVariant data(const QModelIndex& index, int role) const override;
+
+signals:
+    void tidAdded(uint32_t tid);
+
+private:
+    using Seq = uint64_t;      // line number, counting from the first line ever appended
+    using Postings = std::deque<Seq>;
+
+    static constexpr Seq BlockLines = 64; // lines per trigram index block
+    static constexpr uint32_t PruneEvery = 1024; // evicted blocks between sweeps of the trigram index
+
+    struct Entry
+    {
+        uint64_t offset;   // of the text in the arena; grows forever, the arena position is offset % arena size
+        uint32_t length;
+        uint32_t msecs;
+        uint32_t tid;
+        Er::Log::Level level;
+    };
+
+    struct Line
+    {
+        const Record* record;
+        std::string_view text;
+    };
+
+    const Entry& entry(Seq seq) const noexcept
+    {
+        return m_entries[(m_first + std::size_t(seq - m_firstSeq)) % m_entries.size()];
+    }
+
+    std::string_view text(const Entry& e) const noexcept
+    {
+        return std::string_view(m_arena.data() + (e.offset % m_arena.size()), e.length);
+    }
+
+    Seq seqOfRow(int row) const noexcept
+    {
+        return m_filtered ? m_rows[std::size_t(row)] : (m_firstSeq + Seq(row));
+    }
+
+    // where a line of 'length' bytes starting no earlier than 'offset' goes; lines never wrap around the arena end
+    uint64_t place(uint64_t offset, std::size_t length) const noexcept;
+    QString format(const Entry& e) const;
+
+    void indexLine(Seq seq, const Entry& e, std::vector<uint32_t>& newTids);
+    void unindexLine(Seq seq, const Entry& e);
+    void pruneTrigrams();
+    bool matches(Seq seq) const;
+    std::vector<Seq> query() const;
+    std::vector<uint32_t> candidateBlocks() const;
+
+    std::vector<Entry> m_entries; // the ring
+    std::size_t m_first = 0;      // the oldest entry
+    std::size_t m_count = 0;
+    Seq m_firstSeq = 0;           // of the oldest entry
+    std::vector<char> m_arena;
+    uint64_t m_arenaEnd = 0;      // where the next text goes
+
+    std::map<Er::Log::Level, Postings> m_byLevel;
+    std::unordered_map<uint32_t, Postings> m_byTid;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_trigrams; // trigram -> blocks; may refer to evicted blocks until pruned
+    uint32_t m_prunedBlock = 0;   // no blocks below this one are left in m_trigrams
+
+    Filter m_filter;
+    std::string m_needle;         // m_filter.text lowercased
+    bool m_filtered = false;
+    std::deque<Seq> m_rows;       // lines that pass the filter, if m_filtered
+};
+
+} // namespace Ui {}
+
+} // namespace Client {}
+
+} // namespace Erp {}
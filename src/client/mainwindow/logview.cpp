@@ -1,9 +1,16 @@
 #include "../appsettings.hpp"
 #include "logview.hpp"
 
-#include <erebus/util/utf16.hxx>
+#include <algorithm>
 
+#include <QApplication>
+#include <QClipboard>
 #include <QCoreApplication>
+#include <QHBoxLayout>
+#include <QItemSelectionModel>
+#include <QScrollBar>
+#include <QTime>
+#include <QVBoxLayout>
 
 namespace Erp
 {
@@ -30,7 +37,13 @@ LogView::LogView(
     : QObject(mainWindow)
     , m_log(log)
     , m_settings(settings)
-    , m_view(new QPlainTextEdit(parent))
+    , m_level(static_cast<Er::Log::Level>(Erc::Option<int>::get(settings, Erp::Client::AppSettings::Log::level, int(Erp::Client::AppSettings::Log::defaultLevel))))
+    , m_model(new LogModel(this))
+    , m_widget(new QWidget(parent))
+    , m_levelFilter(new QComboBox(m_widget))
+    , m_tidFilter(new QComboBox(m_widget))
+    , m_textFilter(new QLineEdit(m_widget))
+    , m_view(new QListView(m_widget))
     , m_menu(new QMenu(mainWindow))
     , m_actionGroup(new QActionGroup(mainWindow))
     , m_actionDebug(new QAction(QCoreApplication::translate("LogMenu", "Debug", nullptr), m_actionGroup))
@@ -40,23 +53,70 @@ LogView::LogView(
     , m_actionFatal(new QAction(QCoreApplication::translate("LogMenu", "Fatal", nullptr), m_actionGroup))
     , m_actionOff(new QAction(QCoreApplication::translate("LogMenu", "Off", nullptr), m_actionGroup))
     , m_actionClear(new QAction(QCoreApplication::translate("LogMenu", "Clear Log", nullptr), m_menu))
+    , m_actionCopy(new QAction(QCoreApplication::translate("LogMenu", "Copy", nullptr), m_view))
+    , m_ring(RingCapacity)
+    , m_drainTimer(new QTimer(this))
 {
     QFont font;
     font.setFamilies({QString::fromUtf8("Courier New")});
     font.setPointSize(10);
     m_view->setFont(font);
-    m_view->setUndoRedoEnabled(false);
-    m_view->setLineWrapMode(QPlainTextEdit::NoWrap);
-    m_view->setReadOnly(true);
-    m_view->setPlainText(QString::fromUtf8(""));
-    m_view->setPlaceholderText(QString::fromUtf8(""));
+    // every row is a single line of the same font, so the view never has to measure them
+    m_view->setUniformItemSizes(true);
+    m_view->setLayoutMode(QListView::SinglePass);
+    m_view->setWordWrap(false);
+    m_view->setTextElideMode(Qt::ElideNone);
+    m_view->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    m_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_view->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    m_view->setModel(m_model);
+
+    // filtering only hides rows; everything stays in the model
+    m_levelFilter->addItem(QCoreApplication::translate("LogView", "All levels", nullptr), int(Er::Log::Level::Debug));
+    m_levelFilter->addItem(QCoreApplication::translate("LogView", "Info and above", nullptr), int(Er::Log::Level::Info));
+    m_levelFilter->addItem(QCoreApplication::translate("LogView", "Warnings and above", nullptr), int(Er::Log::Level::Warning));
+    m_levelFilter->addItem(QCoreApplication::translate("LogView", "Errors only", nullptr), int(Er::Log::Level::Error));
+    m_levelFilter->addItem(QCoreApplication::translate("LogView", "Fatal only", nullptr), int(Er::Log::Level::Fatal));
+    m_levelFilter->setCurrentIndex(std::max(m_levelFilter->findData(int(m_level)), 0));
+    connect(m_levelFilter, SIGNAL(currentIndexChanged(int)), this, SLOT(applyFilter()));
+
+    m_tidFilter->addItem(QCoreApplication::translate("LogView", "All threads", nullptr));
+    m_tidFilter->setSizeAdjustPolicy(QComboBox::AdjustToContents);
+    connect(m_tidFilter, SIGNAL(currentIndexChanged(int)), this, SLOT(applyFilter()));
+    connect(m_model, SIGNAL(tidAdded(uint32_t)), this, SLOT(addTid(uint32_t)));
+
+    m_textFilter->setPlaceholderText(QCoreApplication::translate("LogView", "Filter", nullptr));
+    m_textFilter->setClearButtonEnabled(true);
+    connect(m_textFilter, SIGNAL(textChanged(QString)), this, SLOT(applyFilter()));
+
+    auto filterBar = new QHBoxLayout();
+    filterBar->setContentsMargins(0, 0, 0, 0);
+    filterBar->addWidget(m_levelFilter);
+    filterBar->addWidget(m_tidFilter);
+    filterBar->addWidget(m_textFilter, 1);
+
+    auto layout = new QVBoxLayout(m_widget);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(2);
+    layout->addLayout(filterBar);
+    layout->addWidget(m_view, 1);
+
+    m_actionCopy->setShortcut(QKeySequence::Copy);
+    m_actionCopy->setShortcutContext(Qt::WidgetShortcut);
+    m_view->addAction(m_actionCopy);
+    connect(m_actionCopy, SIGNAL(triggered()), this, SLOT(copySelection()));
 
     m_actionGroup->setExclusive(true);
     connect(m_actionGroup, SIGNAL(triggered(QAction*)), this, SLOT(setLogLevel(QAction*)));
 
+    m_drainTimer->setSingleShot(true);
+    m_drainTimer->setInterval(DrainInterval);
+    connect(m_drainTimer, SIGNAL(timeout()), this, SLOT(drain()));
+
     actionLog->setMenu(m_menu);
 
-    auto level = m_log->level();
+    // the menu and the level filter are the same setting
+    auto level = m_level;
     m_actionDebug->setCheckable(true);
     m_menu->addAction(m_actionDebug);
     m_actionDebug->setChecked(level == Er::Log::Level::Debug);
@@ -86,53 +146,189 @@ LogView::LogView(
     connect(m_actionClear, SIGNAL(triggered()), this, SLOT(clearLog()));
     m_menu->addAction(m_actionClear);
 
-    auto formatter = Er::Log::SimpleFormatter::make({ 
-        Er::Log::SimpleFormatter::Option::Time, 
-        Er::Log::SimpleFormatter::Option::Level, 
-        Er::Log::SimpleFormatter::Option::Tid,
-        Er::Log::SimpleFormatter::Option::NoNewLine
-    });
-    auto sink = std::make_shared<LogSink>(this, formatter);
+    auto sink = std::make_shared<LogSink>(this);
     m_log->addSink("view", sink);
+
+    applyFilter();
 }
 
 void LogView::clearLog()
 {
-    m_view->clear();
+    m_model->clear();
+
+    // threads show up again as they log
+    m_tidFilter->blockSignals(true);
+    auto current = m_tidFilter->currentData();
+    while (m_tidFilter->count() > 1)
+        m_tidFilter->removeItem(1);
+
+    if (current.isValid())
+    {
+        m_tidFilter->addItem(QString::fromLatin1("@%1").arg(current.toUInt()), current);
+        m_tidFilter->setCurrentIndex(1);
+    }
+
+    m_tidFilter->blockSignals(false);
+}
+
+void LogView::addTid(uint32_t tid)
+{
+    // kept sorted; a thread whose lines all got evicted and then logs again is already here
+    int i = 1;
+    for (; i < m_tidFilter->count(); ++i)
+    {
+        auto existing = m_tidFilter->itemData(i).toUInt();
+        if (existing == tid)
+            return;
+
+        if (existing > tid)
+            break;
+    }
+
+    m_tidFilter->blockSignals(true);
+    m_tidFilter->insertItem(i, QString::fromLatin1("@%1").arg(tid), tid);
+    m_tidFilter->blockSignals(false);
+}
+
+QAction* LogView::actionFor(Er::Log::Level level) const noexcept
+{
+    switch (level)
+    {
+    case Er::Log::Level::Debug: return m_actionDebug;
+    case Er::Log::Level::Info: return m_actionInfo;
+    case Er::Log::Level::Warning: return m_actionWarning;
+    case Er::Log::Level::Error: return m_actionError;
+    case Er::Log::Level::Fatal: return m_actionFatal;
+    default: return m_actionOff;
+    }
+}
+
+void LogView::applyFilter()
+{
+    LogModel::Filter filter;
+    filter.minLevel = Er::Log::Level(m_levelFilter->currentData().toInt());
+
+    if ((m_level < Er::Log::Level::Off) && (filter.minLevel != m_level))
+    {
+        // picked in the filter bar; keep the menu in step
+        auto prevLevel = m_level;
+        m_level = filter.minLevel;
+        actionFor(m_level)->setChecked(true);
+        Erc::Option<int>::set(m_settings, Erp::Client::AppSettings::Log::level, int(m_level));
+
+        emit logLevelChanged(prevLevel, m_level);
+    }
+
+    auto tid = m_tidFilter->currentData();
+    if (tid.isValid())
+        filter.tid = tid.toUInt();
+
+    filter.text = m_textFilter->text().toStdString();
+
+    m_model->setFilter(filter);
+    m_view->scrollToBottom();
+}
+
+void LogView::copySelection()
+{
+    auto rows = m_view->selectionModel()->selectedRows();
+    std::sort(rows.begin(), rows.end(), [](const QModelIndex& a, const QModelIndex& b) { return a.row() < b.row(); });
+
+    QStringList lines;
+    for (auto& index : rows)
+        lines.push_back(m_model->data(index, Qt::DisplayRole).toString());
+
+    if (!lines.isEmpty())
+        QApplication::clipboard()->setText(lines.join(QChar('\n')));
 }
 
-void LogView::log(QString text)
+void LogView::scheduleDrain()
 {
-    m_view->appendPlainText(text);
-    m_view->moveCursor(QTextCursor::End, QTextCursor::MoveAnchor);
-    m_view->moveCursor(QTextCursor::StartOfLine, QTextCursor::MoveAnchor);
+    if (!m_drainTimer->isActive())
+        m_drainTimer->start();
+}
+
+void LogView::drain()
+{
+    // anything written from now on needs another drain
+    m_drainScheduled.store(false, std::memory_order_release);
+
+    std::vector<LogModel::Record> records;
+    while (records.size() < MaxDrainBatch)
+    {
+        auto record = m_ring.pop();
+        if (!record)
+            break;
+
+        records.push_back(std::move(*record));
+    }
+
+    auto dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped)
+    {
+        auto msecs = uint32_t(QTime::currentTime().msecsSinceStartOfDay());
+        auto text = QCoreApplication::translate("LogView", "*** %1 log records dropped ***").arg(qulonglong(dropped));
+        records.emplace_back(msecs, 0, Er::Log::Level::Warning, text.toStdString());
+    }
+
+    if (records.empty())
+        return;
+
+    // keep following the tail unless the user has scrolled away from it
+    auto scrollBar = m_view->verticalScrollBar();
+    bool atBottom = (scrollBar->value() == scrollBar->maximum());
+
+    m_model->append(records);
+
+    if (atBottom)
+        m_view->scrollToBottom();
+
+    // more than one batch was pending
+    if (records.size() >= MaxDrainBatch)
+        scheduleDrain();
 }
 
 void LogView::setLogLevel(QAction* action)
 {
-    auto prevLevel = m_log->level();
-    if (action == m_actionDebug) m_log->setLevel(Er::Log::Level::Debug);
-    else if (action == m_actionInfo) m_log->setLevel(Er::Log::Level::Info);
-    else if (action == m_actionWarning) m_log->setLevel(Er::Log::Level::Warning);
-    else if (action == m_actionError) m_log->setLevel(Er::Log::Level::Error);
-    else if (action == m_actionFatal) m_log->setLevel(Er::Log::Level::Fatal);
-    else if (action == m_actionOff) m_log->setLevel(Er::Log::Level::Off);
+    // only what's shown changes; the sink keeps receiving everything, so lowering
+    // the level brings back the lines logged in the meantime
+    auto prevLevel = m_level;
+    if (action == m_actionDebug) m_level = Er::Log::Level::Debug;
+    else if (action == m_actionInfo) m_level = Er::Log::Level::Info;
+    else if (action == m_actionWarning) m_level = Er::Log::Level::Warning;
+    else if (action == m_actionError) m_level = Er::Log::Level::Error;
+    else if (action == m_actionFatal) m_level = Er::Log::Level::Fatal;
+    else if (action == m_actionOff) m_level = Er::Log::Level::Off;
 
     action->setChecked(true);
 
-    Erc::Option<int>::set(m_settings, Erp::Client::AppSettings::Log::level, int(m_log->level()));
+    Erc::Option<int>::set(m_settings, Erp::Client::AppSettings::Log::level, int(m_level));
+
+    m_widget->setVisible(m_level < Er::Log::Level::Off);
 
-    m_view->setVisible(m_log->level() < Er::Log::Level::Off);
+    if (m_level < Er::Log::Level::Off)
+    {
+        m_levelFilter->blockSignals(true);
+        m_levelFilter->setCurrentIndex(std::max(m_levelFilter->findData(int(m_level)), 0));
+        m_levelFilter->blockSignals(false);
 
-    emit logLevelChanged(prevLevel, m_log->level());
+        applyFilter();
+    }
+
+    emit logLevelChanged(prevLevel, m_level);
 }
 
 void LogView::LogSink::write(Er::Log::Record::Ptr r)
 {
-    auto formatted = formatter->format(r.get());
+    // formatted by the model when the line is actually shown
+    auto msecs = uint32_t(((r->time.hour * 60 + r->time.minute) * 60 + r->time.second) * 1000 + r->time.milli);
+
+    if (!owner->m_ring.push(LogModel::Record(msecs, uint32_t(r->tid), r->level, std::string(r->message))))
+        owner->m_dropped.fetch_add(1, std::memory_order_relaxed);
 
-    auto utf16Message = Erc::fromUtf8(formatted);
-    QMetaObject::invokeMethod(owner, "log", Qt::AutoConnection, Q_ARG(QString, utf16Message));
+    // at most one queued call per drain instead of one per record
+    if (!owner->m_drainScheduled.exchange(true, std::memory_order_acq_rel))
+        QMetaObject::invokeMethod(owner, "scheduleDrain", Qt::QueuedConnection);
 }
 
 void LogView::LogSink::flush()
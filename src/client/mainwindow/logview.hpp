@@ -1,14 +1,23 @@
 #pragma once
 
+#include "../ringbuffer.hpp"
+#include "logmodel.hpp"
+
 #include <erebus/log.hxx>
 #include <erebus-gui/settings.hpp>
 
+#include <atomic>
+
 #include <QAction>
 #include <QActionGroup>
+#include <QComboBox>
 #include <QCoreApplication>
+#include <QLineEdit>
 #include <QMainWindow>
 #include <QMenu>
-#include <QPlainTextEdit>
+#include <QListView>
+#include <QTimer>
+#include <QWidget>
 
 
 
@@ -37,26 +46,44 @@ public:
         QAction* actionLog
     );
 
-    QPlainTextEdit* view() noexcept
+    // the filter bar and the list
+    QWidget* view() noexcept
+    {
+        return m_widget;
+    }
+
+    // the lowest level shown; Off hides the view, the lines are still kept
+    Er::Log::Level level() const noexcept
     {
-        return m_view;
+        return m_level;
     }
 
 signals:
     void logLevelChanged(Er::Log::Level prev, Er::Log::Level now);
 
 public slots:
-    void log(QString text);
     void setLogLevel(QAction* action);
     void clearLog();
 
+private slots:
+    void scheduleDrain();
+    void drain();
+    void copySelection();
+    void applyFilter();
+    void addTid(uint32_t tid);
+
 private:
+    QAction* actionFor(Er::Log::Level level) const noexcept;
+
+    static constexpr std::size_t RingCapacity = 16384; // lines
+    static constexpr int DrainInterval = 50; // msec
+    static constexpr std::size_t MaxDrainBatch = 4096; // lines per timer tick; the rest waits for the next one
+
     struct LogSink
         : public Er::Log::ISink
     {
-        LogSink(LogView* owner, Er::Log::IFormatter::Ptr formatter)
+        explicit LogSink(LogView* owner)
             : owner(owner)
-            , formatter(formatter)
         {}
 
         void write(Er::Log::Record::Ptr r) override;
@@ -64,12 +91,17 @@ private:
 
     private:
         LogView* owner;
-        Er::Log::IFormatter::Ptr formatter;
     };
 
     Er::Log::ILog* m_log;
     Erc::ISettingsStorage* m_settings;
-    QPlainTextEdit* m_view;
+    Er::Log::Level m_level;
+    LogModel* m_model;
+    QWidget* m_widget;
+    QComboBox* m_levelFilter;
+    QComboBox* m_tidFilter;
+    QLineEdit* m_textFilter;
+    QListView* m_view;
     QMenu* m_menu;
     QActionGroup* m_actionGroup;
     QAction* m_actionDebug;
@@ -79,7 +111,12 @@ private:
     QAction* m_actionFatal;
     QAction* m_actionOff;
     QAction* m_actionClear;
-
+    QAction* m_actionCopy;
+    // the sink writes here from any thread; the GUI thread drains it on m_drainTimer
+    RingBuffer<LogModel::Record> m_ring;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<bool> m_drainScheduled = false;
+    QTimer* m_drainTimer;
 };
 
 } // namespace Ui {}
@@ -5,6 +5,7 @@
 #include <QAction>
 #include <QCoreApplication>
 #include <QMainWindow>
+#include <QMenu>
 #include <QMenuBar>
 
 namespace Erp
@@ -24,6 +25,9 @@ struct MainMenu final
         : menuBar(new QMenuBar(mainWindow))
         , menuFile(menuBar->addMenu(QCoreApplication::translate("MainMenu", "File", nullptr)))
         , menuView(menuBar->addMenu(QCoreApplication::translate("MainMenu", "View", nullptr)))
+        , menuDisconnect(new QMenu(QCoreApplication::translate("FileMenu", "Disconnect", nullptr), menuFile))
+        , actionConnect(new QAction(QCoreApplication::translate("FileMenu", "Connect...", nullptr), mainWindow))
+        , actionConnectRecent(new QAction(QCoreApplication::translate("FileMenu", "Connect to recent...", nullptr), mainWindow))
         , actionAlwaysOnTop(new QAction(QCoreApplication::translate("ViewMenu", "Always on top", nullptr), mainWindow))
         , actionHideOnClose(new QAction(QCoreApplication::translate("ViewMenu", "Hide when minimized", nullptr), mainWindow))
         , actionLog(new QAction(QCoreApplication::translate("FileMenu", "Log", nullptr), mainWindow))
@@ -32,6 +36,10 @@ struct MainMenu final
         actionAlwaysOnTop->setCheckable(true);
         actionHideOnClose->setCheckable(true);
 
+        menuFile->addAction(actionConnect);
+        menuFile->addAction(actionConnectRecent);
+        menuFile->addMenu(menuDisconnect);
+        menuFile->addSeparator();
         menuFile->addAction(actionLog);
         menuFile->addSeparator();
         menuFile->addAction(actionExit);
@@ -44,6 +52,9 @@ struct MainMenu final
     QMenuBar* menuBar;
     QMenu* menuFile;
     QMenu* menuView;
+    QMenu* menuDisconnect; // an action per connected endpoint
+    QAction* actionConnect;
+    QAction* actionConnectRecent; // several recent hosts at once, in parallel
     QAction* actionAlwaysOnTop;
     QAction* actionHideOnClose;
     QAction* actionLog;
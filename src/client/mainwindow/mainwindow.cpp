@@ -10,6 +10,9 @@
 #include "mainwindow.hpp"
 #include "pluginlist.hpp"
 
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QListWidget>
 #include <QLocale>
 #include <QMessageBox>
 
@@ -25,18 +28,22 @@ namespace Ui
 
 MainWindow::~MainWindow()
 {
-
+    std::lock_guard l(m_owner->mutex);
+    m_owner->window = nullptr;
 }
 
 MainWindow::MainWindow(
     Er::Log::ILog* log,
     Erc::ISettingsStorage* settings,
+    Erc::IExecutor* executor,
     QWidget* parent
     )
     : Base(parent)
     , m_recentEndpoints(Erc::toUtf8(Erc::Option<QString>::get(settings, Erp::Client::AppSettings::Connections::recentConnections, QString())), Erp::Client::AppSettings::Connections::kMaxRecentConnections)
     , m_log(log)
     , m_settings(settings)
+    , m_executor(executor)
+    , m_owner(std::make_shared<Owner>(this))
     , m_mainMenu(this)
     , m_trayIcon(this, m_mainMenu.actionExit)
     , m_centralWidget(new QWidget(this))
@@ -45,7 +52,7 @@ MainWindow::MainWindow(
     , m_logView(new LogView(log, settings, this, m_mainSplitter, m_mainMenu.actionLog))
     , m_tabWidget(new QTabWidget(m_mainSplitter))
     , m_statusbar(new QStatusBar(this))
-    , m_pluginMgr(Erc::PluginParams(settings, log, m_tabWidget, m_mainMenu.menuBar, m_statusbar))
+    , m_pluginMgr(Erc::PluginParams(settings, log, m_tabWidget, m_mainMenu.menuBar, m_statusbar, executor, Erc::Option<bool>::get(settings, Erp::Client::AppSettings::Application::lazyPlugins, Erp::Client::AppSettings::Application::lazyPluginsDefault)))
 {
     resize(1024, 768);
     QSizePolicy sizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
@@ -84,6 +91,9 @@ MainWindow::MainWindow(
     QObject::connect(m_mainMenu.actionExit, SIGNAL(triggered()), this, SLOT(quit()));
     QObject::connect(m_mainMenu.actionAlwaysOnTop, SIGNAL(triggered()), this, SLOT(toggleAlwaysOnTop()));
     QObject::connect(m_mainMenu.actionHideOnClose, SIGNAL(triggered()), this, SLOT(toggleHideOnClose()));
+    QObject::connect(m_mainMenu.actionConnect, SIGNAL(triggered()), this, SLOT(promptForConnection()));
+    QObject::connect(m_mainMenu.actionConnectRecent, SIGNAL(triggered()), this, SLOT(promptForRecentConnections()));
+    QObject::connect(m_mainMenu.menuDisconnect, SIGNAL(triggered(QAction*)), this, SLOT(disconnectHost(QAction*)));
 
     restoreGeometry();
 
@@ -102,8 +112,7 @@ MainWindow::MainWindow(
     if (!startHidden)
         show();
 
-    m_logView->view()->setMaximumBlockCount(1000000);
-    if (log->level() < Er::Log::Level::Off)
+    if (m_logView->level() < Er::Log::Level::Off)
     {
         m_logView->view()->setVisible(true);
         adjustLogViewHeight();
@@ -123,6 +132,7 @@ MainWindow::MainWindow(
     QObject::connect(this, SIGNAL(disconnected(Er::Client::ChannelPtr)), this, SLOT(onDisconnected(Er::Client::ChannelPtr)));
 
     refreshTitle();
+    refreshDisconnectMenu();
     Er::Log::debug(log, "Client started");
 
     QTimer::singleShot(0, this, SLOT(start()));
@@ -271,14 +281,178 @@ void MainWindow::start()
     if (!checkPlugins())
         quit();
 
-    if (!promptForConnection())
+    // the hosts connected at exit come back in the background
+    if (!reconnect() && !promptForConnection())
         quit();
 
 }
 
+bool MainWindow::reconnect()
+{
+    if (!Erc::Option<bool>::get(m_settings, Erp::Client::AppSettings::Connections::reconnectOnStart, Erp::Client::AppSettings::Connections::reconnectOnStartDefault))
+        return false;
+
+    // endpoints saved by older versions have no settings of their own; the last used ones are the best guess
+    auto open = Erp::Client::unpackEndpointSettings(Erc::toUtf8(Erc::Option<QString>::get(m_settings, Erp::Client::AppSettings::Connections::openConnections, QString())), lastEndpointSettings());
+
+    for (auto& settings : open)
+    {
+        if (!settings.endpoint.empty())
+            connectInBackground(settings);
+    }
+
+    return !m_connecting.empty();
+}
+
+Erp::Client::EndpointSettings MainWindow::lastEndpointSettings() const
+{
+    Erp::Client::EndpointSettings settings;
+    settings.ssl = Erc::Option<bool>::get(m_settings, Erp::Client::AppSettings::Connections::lastUseSsl, false);
+    settings.rootCA = Erc::toUtf8(Erc::Option<QString>::get(m_settings, Erp::Client::AppSettings::Connections::lastRootCA, QString()));
+    settings.certificate = Erc::toUtf8(Erc::Option<QString>::get(m_settings, Erp::Client::AppSettings::Connections::lastCertificate, QString()));
+    settings.key = Erc::toUtf8(Erc::Option<QString>::get(m_settings, Erp::Client::AppSettings::Connections::lastKey, QString()));
+    return settings;
+}
+
+bool MainWindow::connectInBackground(const Erp::Client::EndpointSettings& settings)
+{
+    std::string caCertificate;
+    std::string certificate;
+    std::string key;
+    auto loaded = Er::protectedCall<bool>(
+        m_log,
+        [&]()
+        {
+            if (settings.ssl && !settings.rootCA.empty())
+                caCertificate = Er::Util::loadTextFile(settings.rootCA);
+
+            if (settings.ssl && !settings.certificate.empty())
+                certificate = Er::Util::loadTextFile(settings.certificate);
+
+            if (settings.ssl && !settings.key.empty())
+                key = Er::Util::loadTextFile(settings.key);
+
+            return true;
+        }
+    );
+
+    if (!loaded)
+    {
+        Er::Log::error(m_log, "Not connecting to [{}]: its certificates could not be loaded", settings.endpoint);
+        return false;
+    }
+
+    Er::Log::info(m_log, "Connecting to [{}] in the background", settings.endpoint);
+
+    connectAsync(settings, Er::Client::ChannelParams(settings.endpoint, settings.ssl, caCertificate, certificate, key));
+    return true;
+}
+
+void MainWindow::connectAsync(const Erp::Client::EndpointSettings& settings, const Er::Client::ChannelParams& params)
+{
+    m_connecting.insert(settings.endpoint);
+
+    // channels to different hosts are set up in parallel
+    m_executor->post(
+        [owner = m_owner, log = m_log, settings, params]()
+        {
+            auto channel = Er::protectedCall<Er::Client::ChannelPtr>(
+                log,
+                [&params]()
+                {
+                    return Er::Client::createChannel(params);
+                }
+            );
+
+            std::lock_guard l(owner->mutex);
+            if (auto window = owner->window)
+                QMetaObject::invokeMethod(window, [window, settings, channel]() { window->channelReady(settings, channel); }, Qt::QueuedConnection);
+        }
+    );
+}
+
+void MainWindow::channelReady(const Erp::Client::EndpointSettings& settings, Er::Client::ChannelPtr channel)
+{
+    m_connecting.erase(settings.endpoint);
+
+    if (!channel)
+    {
+        Er::Log::error(m_log, "Could not connect to [{}]", settings.endpoint);
+    }
+    else if (m_connections.find(settings.endpoint) == m_connections.end()) // may have been connected by hand meanwhile
+    {
+        addConnection(settings, channel);
+        return;
+    }
+
+    if (m_connections.empty() && m_connecting.empty())
+        QTimer::singleShot(0, this, SLOT(promptForConnection()));
+}
+
+void MainWindow::addConnection(const Erp::Client::EndpointSettings& settings, Er::Client::ChannelPtr channel)
+{
+    m_connections.insert({ settings.endpoint, Connection{ settings, channel } });
+
+    saveOpenConnections();
+    refreshDisconnectMenu();
+    refreshTitle();
+
+    emit connected(channel, settings.endpoint);
+}
+
+Er::Client::ChannelPtr MainWindow::takeConnection(const std::string& endpoint)
+{
+    auto it = m_connections.find(endpoint);
+    if (it == m_connections.end())
+        return Er::Client::ChannelPtr();
+
+    auto channel = it->second.channel;
+    m_connections.erase(it);
+
+    saveOpenConnections();
+    refreshDisconnectMenu();
+    refreshTitle();
+
+    return channel;
+}
+
+void MainWindow::disconnectHost(QAction* action)
+{
+    auto endpoint = Erc::toUtf8(action->data().toString());
+    Er::Log::info(m_log, "Disconnecting from [{}]", endpoint);
+
+    auto channel = takeConnection(endpoint);
+    if (channel)
+        emit disconnected(channel);
+}
+
+void MainWindow::saveOpenConnections()
+{
+    std::vector<Erp::Client::EndpointSettings> open;
+    open.reserve(m_connections.size());
+    for (auto& connection : m_connections)
+        open.push_back(connection.second.settings);
+
+    Erc::Option<QString>::set(m_settings, Erp::Client::AppSettings::Connections::openConnections, Erc::fromUtf8(Erp::Client::packEndpointSettings(open)));
+}
+
+void MainWindow::refreshDisconnectMenu()
+{
+    m_mainMenu.menuDisconnect->clear();
+
+    for (auto& connection : m_connections)
+    {
+        auto action = m_mainMenu.menuDisconnect->addAction(Erc::fromUtf8(connection.first));
+        action->setData(Erc::fromUtf8(connection.first));
+    }
+
+    m_mainMenu.menuDisconnect->setEnabled(!m_connections.empty());
+}
+
 bool MainWindow::promptForConnection()
 {
     Er::Client::ChannelPtr channel;
+    std::optional<Erp::Client::EndpointSettings> connection;
 
     do
     {
@@ -359,26 +533,63 @@ bool MainWindow::promptForConnection()
             if (!dlg.rootCA().empty())
                 Erc::Option<QString>::set(m_settings, Erp::Client::AppSettings::Connections::lastRootCA, Erc::fromUtf8(dlg.rootCA()));
 
-            auto oldChannel = m_channel;
-            m_channel.reset();
-
-            // we're temporarily disconnected
-            refreshTitle();
-
+            // connecting to the same host again replaces the old connection
+            auto oldChannel = takeConnection(params.endpoint);
             if (oldChannel)
                 emit disconnected(oldChannel);
 
-            m_channel = channel;
-            m_connectionParams = params;
+            connection = Erp::Client::EndpointSettings{ dlg.selected(), dlg.ssl(), dlg.rootCA(), dlg.certificate(), dlg.key() };
         }
 
     } while (!channel);
 
-    emit connected(channel, m_connectionParams->endpoint);
+    addConnection(*connection, channel);
 
     return true;
 }
 
+void MainWindow::promptForRecentConnections()
+{
+    QStringList candidates;
+    for (auto& endpoint : m_recentEndpoints.all())
+    {
+        if (!endpoint.empty() && !m_connections.contains(endpoint) && !m_connecting.contains(endpoint))
+            candidates.push_back(Erc::fromUtf8(endpoint));
+    }
+
+    if (candidates.isEmpty())
+    {
+        QMessageBox::information(this, tr("Connect to recent"), tr("All recent hosts are connected already."));
+        return;
+    }
+
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("Connect to recent"));
+
+    auto layout = new QVBoxLayout(&dlg);
+    auto list = new QListWidget(&dlg);
+    list->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    list->addItems(candidates);
+    layout->addWidget(list);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dlg);
+    layout->addWidget(buttons);
+    QObject::connect(buttons, SIGNAL(accepted()), &dlg, SLOT(accept()));
+    QObject::connect(buttons, SIGNAL(rejected()), &dlg, SLOT(reject()));
+
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+
+    // recent endpoints don't remember their own SSL settings; the last used ones apply to all of them
+    auto defaults = lastEndpointSettings();
+    for (auto item : list->selectedItems())
+    {
+        auto settings = defaults;
+        settings.endpoint = Erc::toUtf8(item->text());
+        connectInBackground(settings);
+    }
+}
+
 Er::Client::ChannelPtr MainWindow::makeChannel(const Er::Client::ChannelParams& params)
 {
     auto channel = Erc::Ui::protectedCall<Er::Client::ChannelPtr>(
@@ -426,12 +637,13 @@ void MainWindow::onConnected(Er::Client::ChannelPtr channel, std::string endpoin
     }
     if (connected == 0)
     {
+        // no plugin has anything for it to disconnect from
+        takeConnection(endpoint);
+
         Erc::Ui::errorBoxLite(QString::fromUtf8(EREBUS_APPLICATION_NAME), tr("Could not connect to %1").arg(QString::fromUtf8(endpoint)), this);
-        QTimer::singleShot(0, this, SLOT(promptForConnection()));
-    }
-    else
-    {
-        refreshTitle();
+
+        if (m_connections.empty() && m_connecting.empty())
+            QTimer::singleShot(0, this, SLOT(promptForConnection()));
     }
 }
 
@@ -447,15 +659,16 @@ void MainWindow::onDisconnected(Er::Client::ChannelPtr channel)
 
 void MainWindow::refreshTitle()
 {
-    if (!m_channel)
+    if (m_connections.empty())
     {
         setWindowTitle(QLatin1String(EREBUS_APPLICATION_NAME));
         m_trayIcon.setToolTip(QLatin1String(EREBUS_APPLICATION_NAME));
     }
     else
     {
-        Q_ASSERT(m_connectionParams);
-        QString connection = Erc::fromUtf8(m_connectionParams->endpoint);
+        QString connection = Erc::fromUtf8(m_connections.begin()->first);
+        if (m_connections.size() > 1)
+            connection = tr("%1 and %2 more").arg(connection).arg(m_connections.size() - 1);
 
         setWindowTitle(connection);
         m_trayIcon.setToolTip(connection);
@@ -466,6 +679,9 @@ size_t MainWindow::loadPlugins(const QStringList& paths)
 {
     size_t count = 0;
 
+    // libraries load in parallel while the plugins are created here one by one
+    m_pluginMgr.prefetch(paths);
+
     for (auto& path: paths)
     {
         if (!m_pluginMgr.exists(path))
@@ -482,6 +698,9 @@ size_t MainWindow::loadPlugins(const QStringList& paths)
                     },
                     path
                 );
+
+            if (plugin)
+                ++count;
         }
 
     }
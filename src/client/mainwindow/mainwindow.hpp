@@ -19,6 +19,10 @@
 #include <QTimer>
 #include <QVBoxLayout>
 
+#include <map>
+#include <mutex>
+#include <set>
+
 namespace Erp
 {
 
@@ -41,6 +45,7 @@ public:
     explicit MainWindow(
         Er::Log::ILog* log,
         Erc::ISettingsStorage* settings,
+        Erc::IExecutor* executor,
         QWidget* parent = nullptr
     );
 
@@ -59,6 +64,8 @@ public slots:
     void toggleHideOnClose();
     void iconActivated(QSystemTrayIcon::ActivationReason reason);
     bool promptForConnection();
+    void promptForRecentConnections();
+    void disconnectHost(QAction* action);
 
 private slots:
     void start();
@@ -74,6 +81,32 @@ private:
     size_t loadPlugins(const QStringList& paths);
 
     Er::Client::ChannelPtr makeChannel(const Er::Client::ChannelParams& params);
+    bool reconnect();
+    Erp::Client::EndpointSettings lastEndpointSettings() const;
+    bool connectInBackground(const Erp::Client::EndpointSettings& settings);
+    void connectAsync(const Erp::Client::EndpointSettings& settings, const Er::Client::ChannelParams& params);
+    void channelReady(const Erp::Client::EndpointSettings& settings, Er::Client::ChannelPtr channel);
+    void addConnection(const Erp::Client::EndpointSettings& settings, Er::Client::ChannelPtr channel);
+    Er::Client::ChannelPtr takeConnection(const std::string& endpoint);
+    void saveOpenConnections();
+    void refreshDisconnectMenu();
+
+    struct Connection
+    {
+        Erp::Client::EndpointSettings settings; // to reconnect with on the next start
+        Er::Client::ChannelPtr channel;
+    };
+
+    // lets the channel creation tasks that outlive the window know it's gone
+    struct Owner
+    {
+        std::mutex mutex;
+        MainWindow* window;
+
+        explicit Owner(MainWindow* window) noexcept
+            : window(window)
+        {}
+    };
 
     enum class SplitterPane
     {
@@ -85,6 +118,8 @@ private:
     Erp::Client::RecentEndpoints m_recentEndpoints;
     Er::Log::ILog* m_log;
     Erc::ISettingsStorage* m_settings;
+    Erc::IExecutor* m_executor;
+    std::shared_ptr<Owner> m_owner;
     MainMenu m_mainMenu;
     TrayIcon m_trayIcon;
     QWidget* m_centralWidget;
@@ -93,8 +128,8 @@ private:
     LogView* m_logView;
     QTabWidget* m_tabWidget;
     QStatusBar* m_statusbar;
-    Er::Client::ChannelPtr m_channel;
-    std::optional<Er::Client::ChannelParams> m_connectionParams;
+    std::map<std::string, Connection> m_connections; // endpoint -> live connection
+    std::set<std::string> m_connecting;               // endpoints whose channels are being created
     Erp::Client::PluginManager m_pluginMgr;
 };
 
@@ -12,34 +12,78 @@ namespace Erp
 namespace Client
 {
 
-Erc::IPlugin* PluginManager::load(const QString& path)
+void PluginManager::openLibrary(PluginInfo* info)
 {
-    auto info = std::make_shared<PluginInfo>(path, m_params.log);
+    auto started = std::chrono::steady_clock::now();
+
     if (!info->dll.load())
     {
         auto error = info->dll.errorString();
-        ErThrow(Er::format("Plugin [{}] could not be loaded", Erc::toUtf8(path)), Er::ExceptionProps::DecodedError(Erc::toUtf8(error)));
+        ErThrow(Er::format("Plugin [{}] could not be loaded", Erc::toUtf8(info->path)), Er::ExceptionProps::DecodedError(Erc::toUtf8(error)));
     }
 
-    auto createUiPluginFn = reinterpret_cast<Erc::createUiPlugin*>(info->dll.resolve("createUiPlugin"));
-    if (!createUiPluginFn)
-        ErThrow(Er::format("Plugin [{}] contains no createUiPlugin symbol", Erc::toUtf8(path)));
+    info->createFn = reinterpret_cast<Erc::createUiPlugin*>(info->dll.resolve("createUiPlugin"));
+    if (!info->createFn)
+        ErThrow(Er::format("Plugin [{}] contains no createUiPlugin symbol", Erc::toUtf8(info->path)));
+
+    info->loadTime = std::chrono::steady_clock::now() - started;
+}
 
-    info->ref.reset(createUiPluginFn(m_params));
+void PluginManager::prefetch(const QStringList& paths)
+{
+    for (auto& path : paths)
+    {
+        if (exists(path) || (m_pending.find(path) != m_pending.end()))
+            continue;
+
+        // QLibrary is a QObject, so it's created here and only used by the background thread
+        auto info = std::make_shared<PluginInfo>(path, m_params.log);
+        auto loaded = std::async(std::launch::async, &PluginManager::openLibrary, info.get());
+        m_pending.insert({ path, Pending{ std::move(info), std::move(loaded) } });
+    }
+}
+
+Erc::IPlugin* PluginManager::load(const QString& path)
+{
+    std::shared_ptr<PluginInfo> info;
+
+    auto pending = m_pending.find(path);
+    if (pending != m_pending.end())
+    {
+        auto prefetched = std::move(pending->second);
+        m_pending.erase(pending);
+
+        prefetched.loaded.get(); // rethrows what openLibrary() threw
+        info = std::move(prefetched.info);
+    }
+    else
+    {
+        info = std::make_shared<PluginInfo>(path, m_params.log);
+        openLibrary(info.get());
+    }
+
+    auto started = std::chrono::steady_clock::now();
+
+    info->ref.reset(info->createFn(m_params));
     if (!info->ref)
         ErThrow(Er::format("Plugin [{}] returned no interface", Erc::toUtf8(path)));
 
+    auto createTime = std::chrono::steady_clock::now() - started;
+
     m_plugins.insert({path, info});
 
     auto pi = info->ref->info();
     Er::Log::info(m_params.log,
-        "Loaded plugin {} ver {}.{}.{} [{}] from [{}]",
+        "Loaded plugin {} ver {}.{}.{} [{}] from [{}] in {} ms (library {} ms, init {} ms)",
         pi.name,
         pi.version.major,
         pi.version.minor,
         pi.version.patch,
         pi.description,
-        Erc::toUtf8(path)
+        Erc::toUtf8(path),
+        std::chrono::duration_cast<std::chrono::milliseconds>(info->loadTime + createTime).count(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(info->loadTime).count(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(createTime).count()
     );
 
     return info->ref.get();
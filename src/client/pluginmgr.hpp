@@ -5,6 +5,8 @@
 #include <erebus-gui/plugin.hpp>
 
 
+#include <chrono>
+#include <future>
 #include <unordered_map>
 #include <vector>
 
@@ -41,6 +43,12 @@ public:
         return m_plugins.size();
     }
 
+    // starts loading the libraries on background threads, all at once; load() picks them up
+    // (the library's static initializers run there too, before the plugin is created);
+    // the QLibrary objects themselves are created here, on the calling thread
+    void prefetch(const QStringList& paths);
+
+    // only the plugin itself is created on the calling thread
     Erc::IPlugin* load(const QString& path);
 
     template <typename Visitor>
@@ -58,6 +66,8 @@ private:
         QString path;
         Er::Log::ILog* log = nullptr;
         QLibrary dll;
+        Erc::createUiPlugin* createFn = nullptr;
+        std::chrono::steady_clock::duration loadTime = {};
         Er::DisposablePtr<Erc::IPlugin> ref;
 
         ~PluginInfo()
@@ -79,8 +89,18 @@ private:
         }
     };
 
+    struct Pending
+    {
+        std::shared_ptr<PluginInfo> info;
+        std::future<void> loaded;
+    };
+
+    // any thread; only loads the library and resolves the entry point of 'info'
+    static void openLibrary(PluginInfo* info);
+
     Erc::PluginParams m_params;
     std::unordered_map<QString, std::shared_ptr<PluginInfo>> m_plugins;
+    std::unordered_map<QString, Pending> m_pending; // destroyed first, so the loads finish before their PluginInfo goes away
 };
 
 
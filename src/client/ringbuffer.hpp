@@ -0,0 +1,117 @@
+#pragma once
+
+#include <erebus/erebus.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace Erp
+{
+
+namespace Client
+{
+
+//
+// bounded lock-free multi-producer multi-consumer queue (Vyukov);
+// push() fails instead of blocking when it's full
+//
+
+template <typename T>
+class RingBuffer final
+    : public Er::NonCopyable
+{
+public:
+    explicit RingBuffer(std::size_t capacity)
+        : m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+        , m_cells(new Cell[m_mask + 1])
+    {
+        for (std::size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(T&& value) noexcept
+    {
+        Cell* cell = nullptr;
+        auto pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            auto seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    std::optional<T> pop() noexcept
+    {
+        Cell* cell = nullptr;
+        auto pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            auto seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = std::intptr_t(seq) - std::intptr_t(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return std::nullopt; // empty
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::optional<T> value(std::move(cell->value));
+        cell->value = T();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+
+        return value;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return m_mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    const std::size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos = 0;
+    alignas(64) std::atomic<std::size_t> m_dequeuePos = 0;
+};
+
+} // namespace Client {}
+
+} // namespace Erp {}
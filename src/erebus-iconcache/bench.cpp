@@ -0,0 +1,341 @@
+#include "loadgen.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+
+namespace
+{
+
+// common freedesktop names that any complete theme has
+const std::vector<std::string> DefaultNames =
+{
+    "application-x-executable", "applications-system", "audio-volume-high", "dialog-error", "dialog-information",
+    "dialog-warning", "document-new", "document-open", "document-save", "edit-copy", "edit-cut", "edit-delete",
+    "edit-find", "edit-paste", "folder", "folder-open", "go-down", "go-home", "go-next", "go-previous", "go-up",
+    "help-about", "image-x-generic", "list-add", "list-remove", "media-playback-start", "network-wired",
+    "preferences-system", "process-stop", "system-file-manager", "system-run", "text-x-generic",
+    "user-trash", "utilities-system-monitor", "utilities-terminal", "view-refresh", "window-close"
+};
+
+constexpr std::size_t MaxDefaultPaths = 64;
+constexpr std::chrono::seconds WarmUpTimeout = std::chrono::seconds(60);
+constexpr std::chrono::seconds StartTimeout = std::chrono::seconds(10);
+
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    if (!list.empty())
+        boost::split(items, list, [](char c) { return (c == ':'); });
+
+    std::erase_if(items, [](const std::string& s) { return s.empty(); });
+    return items;
+}
+
+std::vector<unsigned> parseNumbers(const std::string& list)
+{
+    std::vector<unsigned> numbers;
+    for (auto& item : splitList(list))
+    {
+        auto n = std::strtoul(item.c_str(), nullptr, 10);
+        if (n > 0)
+            numbers.push_back(unsigned(n));
+    }
+
+    return numbers;
+}
+
+std::vector<std::string> findDefaultPaths()
+{
+    std::vector<std::string> paths;
+
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it("/usr/share/pixmaps", ec), end; !ec && (it != end); it.increment(ec))
+    {
+        auto ext = it->path().extension();
+        if ((ext == ".png") || (ext == ".svg") || (ext == ".xpm"))
+            paths.push_back(it->path().string());
+
+        if (paths.size() >= MaxDefaultPaths)
+            break;
+    }
+
+    return paths;
+}
+
+pid_t startDaemon(const std::string& daemon, const std::vector<std::string>& args, bool verbose)
+{
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(daemon.c_str()));
+    for (auto& a : args)
+        argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    auto pid = ::fork();
+    if (pid == 0)
+    {
+        if (!verbose)
+        {
+            auto null = ::open("/dev/null", O_WRONLY);
+            if (null >= 0)
+            {
+                ::dup2(null, STDOUT_FILENO);
+                ::dup2(null, STDERR_FILENO);
+                ::close(null);
+            }
+        }
+
+        ::execv(daemon.c_str(), argv.data());
+        ::_exit(127);
+    }
+
+    return pid;
+}
+
+void stopDaemon(pid_t pid)
+{
+    ::kill(pid, SIGTERM);
+
+    int status = 0;
+    while ((::waitpid(pid, &status, 0) < 0) && (errno == EINTR))
+    {
+    }
+}
+
+// the daemon may not have created the queues yet
+std::shared_ptr<Er::Desktop::IIconCacheIpc> openIpc(Er::Log::ILog* log, const std::string& mqName, std::chrono::seconds timeout)
+{
+    auto mqIn = mqName + "_req";
+    auto mqOut = mqName + "_resp";
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;)
+    {
+        try
+        {
+            return Er::Desktop::openIconCacheIpc(mqIn.c_str(), mqOut.c_str());
+        }
+        catch (std::exception& e)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                Er::Log::Error(log) << "Failed to open message queues " << mqIn << " and " << mqOut << ": " << e.what();
+                return nullptr;
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+void report(Er::Log::ILog* log, const std::string& title, const Erp::IconCache::LoadGenerator::Result& r)
+{
+    Er::Log::Info(log) << title << ": " << r.sent << " sent, " << r.received << " received (" << r.notFound << " not found, " << r.timedOut << " timed out, " << r.lost << " lost) in "
+        << r.seconds << " s; " << r.throughput() << " req/s; latency p50 " << r.p50Us << " us, p90 " << r.p90Us << " us, p99 " << r.p99Us << " us, max " << r.maxUs << " us";
+}
+
+bool runOnce(Er::Log::ILog* log, const std::string& title, const std::string& mqName, const Erp::IconCache::LoadGenerator::Workload& workload, std::vector<std::pair<std::string, Erp::IconCache::LoadGenerator::Result>>& results)
+{
+    auto ipc = openIpc(log, mqName, StartTimeout);
+    if (!ipc)
+        return false;
+
+    Erp::IconCache::LoadGenerator generator(log, ipc, workload);
+    if (!generator.warmUp(WarmUpTimeout))
+    {
+        Er::Log::Error(log) << title << ": the daemon does not respond";
+        return false;
+    }
+
+    auto result = generator.run();
+    report(log, title, result);
+    results.emplace_back(title, result);
+
+    return true;
+}
+
+} // namespace {}
+
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::string mqName;
+        std::string daemon;
+        std::string themeName;
+        std::string workersList;
+        std::string storesList;
+        std::string iconList;
+        std::string pathList;
+        std::string sizeList;
+        std::string modeName;
+        double pathRatio = 0.0;
+        double missRatio = 0.0;
+        unsigned rate = 0;
+        unsigned window = 0;
+        unsigned requestTimeout = 0;
+        unsigned duration = 0;
+        uint32_t seed = 0;
+
+        Erp::IconCache::LoadGenerator::Workload workload;
+
+        namespace po = boost::program_options;
+        po::options_description options("Command line options");
+        options.add_options()
+            ("help,?", "display this message")
+            ("verbose,v", "verbose output, including the daemon's")
+            ("queue", po::value<std::string>(&mqName)->default_value("erebus"), "message queue name of a running daemon")
+            ("daemon", po::value<std::string>(&daemon), "start this erebus-iconcache binary for every --workers x --stores combination instead of using a running one")
+            ("theme", po::value<std::string>(&themeName), "theme name passed to the started daemons")
+            ("workers", po::value<std::string>(&workersList)->default_value("1:2:4"), "server worker counts to compare (colon-separated); needs --daemon")
+            ("stores", po::value<std::string>(&storesList)->default_value("files:pack"), "storage backends to compare (colon-separated); needs --daemon")
+            ("icons", po::value<std::string>(&iconList), "theme icon names to request (colon-separated); a built-in list by default")
+            ("paths", po::value<std::string>(&pathList), "absolute icon paths to request (colon-separated); files from /usr/share/pixmaps by default")
+            ("sizes", po::value<std::string>(&sizeList)->default_value("16:32"), "icon sizes to request (colon-separated)")
+            ("path-ratio", po::value<double>(&pathRatio)->default_value(workload.pathRatio), "share of requests for absolute paths")
+            ("miss-ratio", po::value<double>(&missRatio)->default_value(workload.missRatio), "share of requests for icons that don't exist")
+            ("mode", po::value<std::string>(&modeName)->default_value("path"), "response mode: 'path', 'inline', 'shm' or 'pack'")
+            ("rate", po::value<unsigned>(&rate)->default_value(workload.rate), "target request rate (req/s); 0 means as fast as --window allows")
+            ("window", po::value<unsigned>(&window)->default_value(workload.window), "max requests in flight")
+            ("request-timeout", po::value<unsigned>(&requestTimeout)->default_value(unsigned(workload.requestTimeout.count())), "a request not answered within this (ms) is counted as timed out and frees its slot in the window")
+            ("duration", po::value<unsigned>(&duration)->default_value(unsigned(workload.duration.count())), "measured run duration (seconds)")
+            ("seed", po::value<uint32_t>(&seed)->default_value(workload.seed), "random seed for the request mix")
+        ;
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << options << "\n";
+            return EXIT_SUCCESS;
+        }
+
+        bool verbose = (vm.count("verbose") > 0);
+        Erp::IconCache::Log console(verbose ? Er::Log::Level::Debug : Er::Log::Level::Info);
+
+        Er::LibScope er(&console);
+
+        workload.names = vm.count("icons") ? splitList(iconList) : DefaultNames;
+        workload.paths = vm.count("paths") ? splitList(pathList) : findDefaultPaths();
+        workload.sizes = parseNumbers(sizeList);
+        workload.pathRatio = pathRatio;
+        workload.missRatio = missRatio;
+        workload.rate = rate;
+        workload.window = std::max(window, 1U);
+        workload.requestTimeout = std::chrono::milliseconds(std::max(requestTimeout, 1U));
+        workload.duration = std::chrono::seconds(duration);
+        workload.seed = seed;
+
+        if (modeName == "path")
+        {
+            workload.mode = Erp::IconCache::Protocol::ResponseMode::Path;
+        }
+        else if (modeName == "inline")
+        {
+            workload.mode = Erp::IconCache::Protocol::ResponseMode::Inline;
+        }
+        else if (modeName == "shm")
+        {
+            workload.mode = Erp::IconCache::Protocol::ResponseMode::Shared;
+        }
+        else if (modeName == "pack")
+        {
+            workload.mode = Erp::IconCache::Protocol::ResponseMode::Pack;
+        }
+        else
+        {
+            std::cerr << "Unknown response mode " << modeName << "\n";
+            std::cerr << options << "\n";
+            return EXIT_FAILURE;
+        }
+
+        if (workload.sizes.empty() || (workload.names.empty() && workload.paths.empty()))
+        {
+            std::cerr << "Nothing to request\n";
+            std::cerr << options << "\n";
+            return EXIT_FAILURE;
+        }
+
+        Er::Log::Info(&console) << "Workload: " << workload.names.size() << " names, " << workload.paths.size() << " paths, " << workload.sizes.size() << " sizes; "
+            << (workload.pathRatio * 100.0) << "% paths, " << (workload.missRatio * 100.0) << "% misses, " << workload.rate << " req/s for " << workload.duration.count() << " s";
+
+        std::vector<std::pair<std::string, Erp::IconCache::LoadGenerator::Result>> results;
+
+        if (daemon.empty())
+        {
+            runOnce(&console, mqName, mqName, workload, results);
+        }
+        else
+        {
+            // every daemon starts with an empty cache of its own
+            std::string scratch = (std::filesystem::temp_directory_path() / "erebus-bench-XXXXXX").string();
+            if (!::mkdtemp(scratch.data()))
+            {
+                std::cerr << "Failed to create a temporary directory\n";
+                return EXIT_FAILURE;
+            }
+
+            std::string benchQueue = "erebus_bench_" + std::to_string(::getpid());
+
+            for (auto& store : splitList(storesList))
+            {
+                for (auto workers : parseNumbers(workersList))
+                {
+                    auto title = "store=" + store + " workers=" + std::to_string(workers);
+                    auto cacheDir = scratch + "/" + store + "-" + std::to_string(workers);
+
+                    std::vector<std::string> args = { "--queue", benchQueue, "--cache", cacheDir, "--store", store, "--workers-min", std::to_string(workers), "--workers-max", std::to_string(workers) };
+                    if (!themeName.empty())
+                    {
+                        args.push_back("--theme");
+                        args.push_back(themeName);
+                    }
+
+                    auto pid = startDaemon(daemon, args, verbose);
+                    if (pid < 0)
+                    {
+                        Er::Log::Error(&console) << "Failed to start " << daemon;
+                        break;
+                    }
+
+                    runOnce(&console, title, benchQueue, workload, results);
+
+                    stopDaemon(pid);
+                }
+            }
+
+            std::error_code ec;
+            std::filesystem::remove_all(scratch, ec);
+        }
+
+        if (results.size() > 1)
+        {
+            Er::Log::Info(&console) << "Summary:";
+            for (auto& [title, r] : results)
+                Er::Log::Info(&console) << "  " << title << ": " << r.throughput() << " req/s, p50 " << r.p50Us << " us, p99 " << r.p99Us << " us";
+        }
+
+        return results.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Unexpected error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
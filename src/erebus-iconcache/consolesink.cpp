@@ -0,0 +1,183 @@
+#include "consolesink.hpp"
+
+#include <erebus/system/thread.hxx>
+
+#include <bit>
+#include <cerrno>
+#include <vector>
+
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+ConsoleSink::~ConsoleSink()
+{
+    m_stop.store(true, std::memory_order_release);
+    m_signal.fetch_add(1, std::memory_order_release);
+    m_signal.notify_one();
+
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
+ConsoleSink::ConsoleSink(std::size_t capacity)
+    : m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+    , m_cells(new Cell[m_mask + 1])
+{
+    for (std::size_t i = 0; i <= m_mask; ++i)
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+
+    m_writer = std::thread([this]() { run(); });
+}
+
+void ConsoleSink::write(std::string&& line, bool error) noexcept
+{
+    if (!push(std::move(line), error))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    m_signal.fetch_add(1, std::memory_order_release);
+    m_signal.notify_one();
+}
+
+bool ConsoleSink::push(std::string&& line, bool error) noexcept
+{
+    Cell* cell = nullptr;
+    auto pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        cell = &m_cells[pos & m_mask];
+        auto seq = cell->seq.load(std::memory_order_acquire);
+        auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+        if (diff == 0)
+        {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false; // full
+        }
+        else
+        {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->line = std::move(line);
+    cell->error = error;
+    cell->seq.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+std::size_t ConsoleSink::drain() noexcept
+{
+    std::vector<std::string> lines;
+    std::vector<bool> errors;
+    lines.reserve(MaxBatch);
+    errors.reserve(MaxBatch);
+
+    while (lines.size() < MaxBatch)
+    {
+        auto& cell = m_cells[m_dequeuePos & m_mask];
+        if (cell.seq.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            break; // empty
+
+        lines.push_back(std::move(cell.line));
+        errors.push_back(cell.error);
+        cell.line.clear();
+
+        cell.seq.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePos;
+    }
+
+    // keep the order of lines across both streams: one writev() per run of the same stream
+    std::vector<iovec> iov;
+    iov.reserve(lines.size());
+
+    std::size_t i = 0;
+    while (i < lines.size())
+    {
+        auto error = errors[i];
+        iov.clear();
+
+        for (; (i < lines.size()) && (errors[i] == error); ++i)
+            iov.push_back(iovec{ lines[i].data(), lines[i].size() });
+
+        writeAll(error ? STDERR_FILENO : STDOUT_FILENO, iov.data(), int(iov.size()));
+    }
+
+    return lines.size();
+}
+
+void ConsoleSink::writeAll(int fd, iovec* iov, int count) noexcept
+{
+    while (count > 0)
+    {
+        auto written = ::writev(fd, iov, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return; // nowhere to report it
+        }
+
+        // skip what's been written and retry the rest
+        auto n = std::size_t(written);
+        while ((count > 0) && (n >= iov->iov_len))
+        {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+void ConsoleSink::run() noexcept
+{
+    Er::System::CurrentThread::setName("iconcache_log");
+
+    for (;;)
+    {
+        auto signal = m_signal.load(std::memory_order_acquire);
+
+        auto written = drain();
+
+        auto dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped)
+        {
+            auto msg = "[" + std::to_string(dropped) + " log records dropped]\n";
+            iovec iov{ msg.data(), msg.size() };
+            writeAll(STDERR_FILENO, &iov, 1);
+        }
+
+        if (written)
+            continue;
+
+        if (m_stop.load(std::memory_order_acquire))
+            break;
+
+        m_signal.wait(signal, std::memory_order_acquire);
+    }
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
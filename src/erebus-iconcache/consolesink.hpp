@@ -0,0 +1,69 @@
+#pragma once
+
+#include <erebus/erebus.hxx>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <sys/uio.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// stdout/stderr writer for preformatted log lines
+//
+// write() never blocks or locks: it puts the line into a bounded ring
+// (a Vyukov MPMC queue used with a single consumer), and a writer thread
+// drains it in writev() batches. Lines that don't fit are dropped and
+// counted; the count is reported on stderr once there's room again.
+//
+
+class ConsoleSink final
+    : public Er::NonCopyable
+{
+public:
+    ~ConsoleSink();
+    explicit ConsoleSink(std::size_t capacity = DefaultCapacity);
+
+    // 'line' must include the trailing newline
+    void write(std::string&& line, bool error) noexcept;
+
+    static constexpr std::size_t DefaultCapacity = 8192; // lines; rounded up to a power of 2
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> seq;
+        std::string line;
+        bool error = false;
+    };
+
+    static constexpr std::size_t MaxBatch = 256; // lines per writev()
+
+    bool push(std::string&& line, bool error) noexcept;
+    void run() noexcept;
+    std::size_t drain() noexcept;
+    static void writeAll(int fd, iovec* iov, int count) noexcept;
+
+    const std::size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos = 0;
+    alignas(64) std::size_t m_dequeuePos = 0; // owned by the writer thread
+    alignas(64) std::atomic<uint32_t> m_signal = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<bool> m_stop = false;
+    std::thread m_writer;
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
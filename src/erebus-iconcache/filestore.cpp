@@ -0,0 +1,602 @@
+#include "iconstore.hpp"
+
+#include <erebus/util/posixerror.hxx>
+#include <erebus-desktop/ic.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace
+{
+
+// (name, size) of every icon we've written, with its last use; lets eviction
+// and compaction survive restarts. Lines are '<last use>\t<size>\t<name>'.
+constexpr std::string_view ManifestFileName = "files.manifest";
+
+int64_t now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string makeEntryKey(std::string_view name, unsigned size)
+{
+    std::string key(name);
+    key.push_back('\0');
+    key.append(std::to_string(size));
+    return key;
+}
+
+std::string normalPath(const std::string& path)
+{
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+
+class FileStore final
+    : public IIconStore
+    , public Er::NonCopyable
+{
+public:
+    ~FileStore()
+    {
+        save(true);
+    }
+
+    explicit FileStore(Er::Log::ILog* log, std::string_view cacheDir, std::string_view icoFormat)
+        : m_log(log)
+        , m_cacheDir(cacheDir)
+        , m_icoFormat(icoFormat)
+        , m_manifestPath(normalPath(m_cacheDir + "/" + std::string(ManifestFileName)))
+    {
+        load();
+    }
+
+    std::optional<IconInfo> find(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto iconFilePath = Er::Desktop::makeIconCachePath(m_cacheDir, std::string(name), size, m_icoFormat);
+
+            struct stat fs = {};
+            if (::stat(iconFilePath.c_str(), &fs) != 0)
+            {
+                forget(name, size);
+                return std::nullopt;
+            }
+
+            // empty files are negative results left by older daemons
+            if (fs.st_size == 0)
+            {
+                Er::Log::Debug(m_log) << "Found NULL cached icon [" << name << "] at [" << iconFilePath << "]";
+                return IconInfo(IconInfo::Type::Invalid);
+            }
+
+            remember(name, size, iconFilePath, uint64_t(fs.st_size));
+
+            Er::Log::Debug(m_log) << "Found cached icon [" << name << "] at [" << iconFilePath << "]";
+            return IconInfo(IconInfo::Type::Valid, iconFilePath);
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return std::nullopt;
+    }
+
+    IconInfo put(std::string_view name, unsigned size, std::string_view data) noexcept override
+    {
+        try
+        {
+            auto iconFilePath = Er::Desktop::makeIconCachePath(m_cacheDir, std::string(name), size, m_icoFormat);
+            if (writeFile(iconFilePath, data))
+            {
+                remember(name, size, iconFilePath, data.size());
+                return IconInfo(IconInfo::Type::Valid, iconFilePath);
+            }
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return IconInfo(IconInfo::Type::Invalid);
+    }
+
+    std::optional<std::string> read(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto iconFilePath = Er::Desktop::makeIconCachePath(m_cacheDir, std::string(name), size, m_icoFormat);
+            return readFile(iconFilePath);
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return std::nullopt;
+    }
+
+    void touch(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto key = makeEntryKey(name, size);
+
+            std::shared_lock l(m_mutex);
+
+            auto it = m_entries.find(key);
+            if (it != m_entries.end())
+                it->second.lastUsed.store(now(), std::memory_order_relaxed);
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+    }
+
+    uint64_t diskUsage() const noexcept override
+    {
+        return m_usage.load(std::memory_order_relaxed);
+    }
+
+    uint64_t generation() const noexcept override
+    {
+        return 0; // files never move
+    }
+
+    std::vector<Key> evict(uint64_t budget) noexcept override
+    {
+        std::vector<Key> evicted;
+
+        try
+        {
+            std::unique_lock l(m_mutex);
+
+            if (m_usage.load(std::memory_order_relaxed) <= budget)
+                return evicted;
+
+            struct Candidate
+            {
+                int64_t lastUsed;
+                const std::string* key; // in m_entries, or a path in m_orphans if it's an orphan
+                bool orphan;
+            };
+
+            std::vector<Candidate> candidates;
+            candidates.reserve(m_entries.size() + m_orphans.size());
+            for (auto& [key, e] : m_entries)
+                candidates.push_back(Candidate{ e.lastUsed.load(std::memory_order_relaxed), &key, false });
+            for (auto& [path, e] : m_orphans)
+                candidates.push_back(Candidate{ e.lastUsed.load(std::memory_order_relaxed), &path, true });
+
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.lastUsed < b.lastUsed; });
+
+            // the files are removed with the lock held so that a concurrent put() of the same icon can't be lost
+            std::size_t orphans = 0;
+            for (auto& c : candidates)
+            {
+                if (m_usage.load(std::memory_order_relaxed) <= budget)
+                    break;
+
+                if (c.orphan)
+                {
+                    auto it = m_orphans.find(*c.key);
+                    removeFile(it->first, it->second.bytes);
+                    m_orphans.erase(it);
+                    ++orphans;
+                }
+                else
+                {
+                    auto it = m_entries.find(*c.key);
+                    removeFile(it->second.path, it->second.bytes);
+                    evicted.push_back(keyOf(it->first));
+                    m_entries.erase(it);
+                }
+            }
+
+            m_dirty = true;
+
+            Er::Log::Info(m_log) << "Evicted " << (evicted.size() + orphans) << " icons from [" << m_cacheDir << "], " << m_usage.load(std::memory_order_relaxed) << " bytes left";
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return evicted;
+    }
+
+    std::vector<Key> removeIf(const std::function<bool(std::string_view name)>& stale) noexcept override
+    {
+        std::vector<Key> removed;
+
+        try
+        {
+            std::vector<std::string> keys;
+
+            {
+                std::shared_lock l(m_mutex);
+
+                keys.reserve(m_entries.size());
+                for (auto& [key, e] : m_entries)
+                    keys.push_back(key);
+            }
+
+            // orphans can't be checked as their names are unknown; they only go away by eviction
+            std::vector<std::string> staleKeys;
+            for (auto& key : keys)
+            {
+                if (stale(std::string_view(key.data(), key.find('\0'))))
+                    staleKeys.push_back(std::move(key));
+            }
+
+            if (staleKeys.empty())
+                return removed;
+
+            std::unique_lock l(m_mutex);
+
+            for (auto& key : staleKeys)
+            {
+                auto it = m_entries.find(key);
+                if (it == m_entries.end())
+                    continue;
+
+                removeFile(it->second.path, it->second.bytes);
+                removed.push_back(keyOf(it->first));
+                m_entries.erase(it);
+            }
+
+            m_dirty = true;
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return removed;
+    }
+
+    void flush() noexcept override
+    {
+        save(false);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // last use times change all the time, so they alone don't make the manifest rewritten more often
+    static constexpr std::chrono::minutes SaveInterval = std::chrono::minutes(10);
+
+    struct Entry
+    {
+        std::string path;
+        uint64_t bytes = 0;
+        std::atomic<int64_t> lastUsed = 0; // seconds since the epoch
+    };
+
+    void save(bool force) noexcept
+    {
+        try
+        {
+            std::string text;
+
+            {
+                std::unique_lock l(m_mutex);
+
+                if (!force && !m_dirty && (Clock::now() - m_lastSaved < SaveInterval))
+                    return;
+
+                for (auto& [key, e] : m_entries)
+                {
+                    auto name = std::string_view(key.data(), key.find('\0'));
+                    if (name.find('\n') != std::string_view::npos)
+                        continue;
+
+                    text.append(std::to_string(e.lastUsed.load(std::memory_order_relaxed)));
+                    text.push_back('\t');
+                    text.append(key, name.size() + 1);
+                    text.push_back('\t');
+                    text.append(name);
+                    text.push_back('\n');
+                }
+
+                m_dirty = false;
+                m_lastSaved = Clock::now();
+            }
+
+            if (!writeFile(m_manifestPath, text))
+            {
+                std::unique_lock l(m_mutex);
+                m_dirty = true;
+            }
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+    }
+
+    static Key keyOf(const std::string& entryKey)
+    {
+        auto separator = entryKey.find('\0');
+        return Key{ entryKey.substr(0, separator), unsigned(std::stoul(entryKey.substr(separator + 1))) };
+    }
+
+    void load()
+    {
+        std::unordered_set<std::string> known;
+
+        // icons written by us before
+        std::ifstream manifest(m_manifestPath);
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            auto tab1 = line.find('\t');
+            auto tab2 = (tab1 == std::string::npos) ? std::string::npos : line.find('\t', tab1 + 1);
+            if (tab2 == std::string::npos)
+                continue;
+
+            int64_t lastUsed = 0;
+            unsigned size = 0;
+            try
+            {
+                lastUsed = std::stoll(line.substr(0, tab1));
+                size = unsigned(std::stoul(line.substr(tab1 + 1, tab2 - tab1 - 1)));
+            }
+            catch (std::exception&)
+            {
+                continue;
+            }
+
+            auto name = line.substr(tab2 + 1);
+            auto path = Er::Desktop::makeIconCachePath(m_cacheDir, name, size, m_icoFormat);
+
+            struct stat fs = {};
+            if ((::stat(path.c_str(), &fs) != 0) || (fs.st_size == 0))
+                continue;
+
+            auto& e = m_entries[makeEntryKey(name, size)];
+            e.path = path;
+            e.bytes = uint64_t(fs.st_size);
+            e.lastUsed.store(lastUsed, std::memory_order_relaxed);
+            m_usage.fetch_add(e.bytes, std::memory_order_relaxed);
+
+            known.insert(normalPath(path));
+        }
+
+        // icons written by older daemons or in another format; their names are unknown
+        // until they're asked for, so they're aged by modification time
+        std::error_code ec;
+        for (std::filesystem::recursive_directory_iterator it(m_cacheDir, ec), end; !ec && (it != end); it.increment(ec))
+        {
+            std::error_code ec2;
+            if (!it->is_regular_file(ec2) || ec2)
+                continue;
+
+            auto path = it->path().lexically_normal().string();
+            if ((path == m_manifestPath) || known.count(path))
+                continue;
+
+            auto ext = it->path().extension().string();
+            if ((ext != ".png") && (ext != ".argb") && (ext != m_icoFormat))
+                continue;
+
+            struct stat fs = {};
+            if (::stat(path.c_str(), &fs) != 0)
+                continue;
+
+            auto& e = m_orphans[path];
+            e.bytes = uint64_t(fs.st_size);
+            e.lastUsed.store(int64_t(fs.st_mtime), std::memory_order_relaxed);
+            m_usage.fetch_add(e.bytes, std::memory_order_relaxed);
+        }
+
+        Er::Log::Info(m_log) << "Icon cache [" << m_cacheDir << "] holds " << m_entries.size() << " known and " << m_orphans.size() << " unknown icons, " << m_usage.load(std::memory_order_relaxed) << " bytes";
+    }
+
+    void remember(std::string_view name, unsigned size, const std::string& path, uint64_t bytes)
+    {
+        auto key = makeEntryKey(name, size);
+
+        {
+            std::shared_lock l(m_mutex);
+
+            auto it = m_entries.find(key);
+            if ((it != m_entries.end()) && (it->second.bytes == bytes))
+            {
+                it->second.lastUsed.store(now(), std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        std::unique_lock l(m_mutex);
+
+        // an orphan has just got its name
+        auto orphan = m_orphans.find(normalPath(path));
+        if (orphan != m_orphans.end())
+        {
+            m_usage.fetch_sub(orphan->second.bytes, std::memory_order_relaxed);
+            m_orphans.erase(orphan);
+        }
+
+        auto& e = m_entries[key];
+        m_usage.fetch_sub(e.bytes, std::memory_order_relaxed);
+        e.path = path;
+        e.bytes = bytes;
+        e.lastUsed.store(now(), std::memory_order_relaxed);
+        m_usage.fetch_add(bytes, std::memory_order_relaxed);
+        m_dirty = true;
+    }
+
+    void forget(std::string_view name, unsigned size)
+    {
+        auto key = makeEntryKey(name, size);
+
+        std::unique_lock l(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+            return;
+
+        m_usage.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+        m_entries.erase(it);
+        m_dirty = true;
+    }
+
+    // m_mutex is held exclusively by the caller
+    void removeFile(const std::string& path, uint64_t bytes) noexcept
+    {
+        if ((::unlink(path.c_str()) != 0) && (errno != ENOENT))
+        {
+            auto e = errno;
+            auto msg = Er::Util::posixErrorToString(e);
+            Er::Log::Warning(m_log) << "Failed to remove [" << path << "]: " << e << " " << msg;
+        }
+
+        m_usage.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    std::optional<std::string> readFile(const std::string& path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            auto e = errno;
+            auto msg = Er::Util::posixErrorToString(e);
+            Er::Log::Error(m_log) << "Failed to open [" << path << "]: " << e << " " << msg;
+            return std::nullopt;
+        }
+
+        std::string data;
+        char buffer[16384];
+        for (;;)
+        {
+            auto r = ::read(fd, buffer, sizeof(buffer));
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                auto e = errno;
+                auto msg = Er::Util::posixErrorToString(e);
+                Er::Log::Error(m_log) << "Failed to read [" << path << "]: " << e << " " << msg;
+
+                ::close(fd);
+                return std::nullopt;
+            }
+
+            if (r == 0)
+                break;
+
+            data.append(buffer, std::size_t(r));
+        }
+
+        ::close(fd);
+
+        if (data.empty())
+            return std::nullopt; // a negative result left by an older daemon
+
+        return data;
+    }
+
+    // readers must never see a partially written icon, so write a temporary and rename it
+    bool writeFile(const std::string& path, std::string_view data) noexcept
+    {
+        std::string tmpPath(path);
+        tmpPath.append(".XXXXXX");
+
+        auto fd = ::mkstemp(tmpPath.data());
+        if (fd < 0)
+        {
+            auto e = errno;
+            auto msg = Er::Util::posixErrorToString(e);
+            Er::Log::Error(m_log) << "Failed to create [" << tmpPath << "]: " << e << " " << msg;
+            return false;
+        }
+
+        // mkstemp() creates it private
+        ::fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+        auto p = data.data();
+        auto remaining = data.size();
+        while (remaining > 0)
+        {
+            auto written = ::write(fd, p, remaining);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                auto e = errno;
+                auto msg = Er::Util::posixErrorToString(e);
+                Er::Log::Error(m_log) << "Failed to write [" << tmpPath << "]: " << e << " " << msg;
+
+                ::close(fd);
+                ::unlink(tmpPath.c_str());
+                return false;
+            }
+
+            p += written;
+            remaining -= std::size_t(written);
+        }
+
+        ::close(fd);
+
+        if (::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            auto e = errno;
+            auto msg = Er::Util::posixErrorToString(e);
+            Er::Log::Error(m_log) << "Failed to rename [" << tmpPath << "] to [" << path << "]: " << e << " " << msg;
+
+            ::unlink(tmpPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    Er::Log::ILog* m_log;
+    std::string m_cacheDir;
+    std::string m_icoFormat;
+    const std::string m_manifestPath;
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries; // (name, size) -> icon file
+    std::unordered_map<std::string, Entry> m_orphans; // path -> icon file of unknown (name, size)
+    std::atomic<uint64_t> m_usage = 0;
+    bool m_dirty = false; // m_entries changed since the manifest was written
+    Clock::time_point m_lastSaved = Clock::now();
+};
+
+
+} // namespace {}
+
+
+std::unique_ptr<IIconStore> createFileStore(Er::Log::ILog* log, std::string_view cacheDir, std::string_view icoFormat)
+{
+    return std::make_unique<FileStore>(log, cacheDir, icoFormat);
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
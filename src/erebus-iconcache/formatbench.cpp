@@ -0,0 +1,124 @@
+#include "formatbench.hpp"
+
+#include <erebus-gui/rawicon.hpp>
+
+#include <chrono>
+
+#include <QBuffer>
+#include <QIcon>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace
+{
+
+struct FormatStats
+{
+    const char* name;
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    uint64_t bytes = 0;
+    uint64_t footprint = 0; // as individual files on a 4K-block filesystem
+    std::size_t failures = 0;
+
+    explicit FormatStats(const char* name) : name(name) {}
+};
+
+constexpr uint64_t BlockSize = 4096;
+
+
+} // namespace {}
+
+
+void benchmarkFormats(Er::Log::ILog* log, const std::vector<std::string>& names, const std::vector<unsigned>& sizes)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // rasterize up front; that's not what's being measured
+    std::vector<QImage> images;
+    for (auto& name : names)
+    {
+        auto ico = QIcon::fromTheme(QString::fromUtf8(name));
+        if (ico.isNull())
+            continue;
+
+        for (auto size : sizes)
+        {
+            auto image = ico.pixmap(int(size)).toImage();
+            if (!image.isNull())
+                images.push_back(std::move(image));
+        }
+    }
+
+    if (images.empty())
+    {
+        Er::Log::Warning(log) << "No icons to benchmark";
+        return;
+    }
+
+    Er::Log::Info(log) << "Benchmarking " << images.size() << " images (" << names.size() << " names x " << sizes.size() << " sizes)";
+
+    FormatStats png("png");
+    FormatStats raw("argb32");
+
+    for (auto& image : images)
+    {
+        {
+            auto started = Clock::now();
+
+            QByteArray bytes;
+            QBuffer buffer(&bytes);
+            buffer.open(QIODevice::WriteOnly);
+            bool ok = image.save(&buffer, "png");
+
+            auto encoded = Clock::now();
+
+            QImage decoded;
+            ok = ok && decoded.loadFromData(bytes, "png");
+
+            png.encodeSeconds += std::chrono::duration<double>(encoded - started).count();
+            png.decodeSeconds += std::chrono::duration<double>(Clock::now() - encoded).count();
+            png.bytes += uint64_t(bytes.size());
+            png.footprint += (uint64_t(bytes.size()) + BlockSize - 1) / BlockSize * BlockSize;
+            if (!ok)
+                ++png.failures;
+        }
+
+        {
+            auto started = Clock::now();
+
+            auto bytes = Erc::RawIcon::encode(image);
+
+            auto encoded = Clock::now();
+
+            // wrap() alone copies nothing; a consumer keeps an image of its own, as loadFromData() gives for PNG
+            auto decoded = Erc::RawIcon::wrap(bytes.constData(), std::size_t(bytes.size())).copy();
+
+            raw.encodeSeconds += std::chrono::duration<double>(encoded - started).count();
+            raw.decodeSeconds += std::chrono::duration<double>(Clock::now() - encoded).count();
+            raw.bytes += uint64_t(bytes.size());
+            raw.footprint += (uint64_t(bytes.size()) + BlockSize - 1) / BlockSize * BlockSize;
+            if (decoded.isNull())
+                ++raw.failures;
+        }
+    }
+
+    for (auto* s : { &png, &raw })
+    {
+        auto n = double(images.size());
+        Er::Log::Info(log) << s->name << ": encode " << (s->encodeSeconds * 1e6 / n) << " us/icon, decode " << (s->decodeSeconds * 1e6 / n)
+            << " us/icon, total " << ((s->encodeSeconds + s->decodeSeconds) * 1000.0) << " ms; "
+            << s->bytes << " bytes (" << (s->bytes / images.size()) << " per icon), " << s->footprint << " bytes as files; "
+            << s->failures << " failures";
+    }
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
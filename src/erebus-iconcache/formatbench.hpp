@@ -0,0 +1,26 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <string>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// compares PNG and raw ARGB32 (see Erc::RawIcon) for encode and decode latency
+// and for the space the encoded icons take in a cache
+//
+
+void benchmarkFormats(Er::Log::ILog* log, const std::vector<std::string>& names, const std::vector<unsigned>& sizes);
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -1,12 +1,15 @@
 #include "iconcache.hpp"
 
 #include <erebus/exception.hxx>
+#include <erebus/system/thread.hxx>
 #include <erebus/util/format.hxx>
-#include <erebus/util/posixerror.hxx>
-#include <erebus-desktop/ic.hxx>
+#include <erebus-gui/rawicon.hpp>
 
-#include <sys/stat.h>
+#include <unordered_set>
 
+#include <unistd.h>
+
+#include <QBuffer>
 #include <QIcon>
 
 namespace Erp
@@ -16,16 +19,42 @@ namespace IconCache
 {
 
 
-IconCache::IconCache(Er::Log::ILog* log, std::string_view themeName, std::string_view cacheDir, std::string_view icoFormat)
+IconCache::~IconCache()
+{
+    m_rechecker.request_stop();
+    if (m_rechecker.joinable())
+        m_rechecker.join();
+
+    m_store->flush();
+    logStats();
+}
+
+IconCache::IconCache(Er::Log::ILog* log, std::string_view themeName, std::string_view cacheDir, const Params& params)
     : m_log(log)
     , m_cacheDir(cacheDir)
-    , m_icoFormat(icoFormat)
+    , m_icoFormat(params.icoFormat)
+    , m_sizeSet(params.sizeSet)
+    , m_diskBudget(params.diskBudget)
+    , m_lru(params.lruCapacity)
+    , m_negative(log, cacheDir, params.negativeTtl)
+    , m_lastStatsLogged(Clock::now().time_since_epoch().count())
+    , m_lastCompaction(Clock::now() - CompactionInterval) // the first pass does it
 {
     if (!themeName.empty())
         QIcon::setThemeName(QString::fromUtf8(themeName));
 
-    ErAssert(!icoFormat.empty());
-    ErAssert(icoFormat.front() == '.');
+    std::vector<std::string> searchPaths;
+    for (auto& path : QIcon::themeSearchPaths())
+    {
+        // skip Qt resources
+        if (!path.startsWith(':'))
+            searchPaths.push_back(path.toStdString());
+    }
+
+    m_themeIndex = std::make_unique<ThemeIndex>(m_log, QIcon::themeName().toStdString(), searchPaths);
+
+    ErAssert(!m_icoFormat.empty());
+    ErAssert(m_icoFormat.front() == '.');
 
     std::filesystem::path path(m_cacheDir);
     std::error_code ec;
@@ -42,123 +71,530 @@ IconCache::IconCache(Er::Log::ILog* log, std::string_view themeName, std::string
         if (!std::filesystem::create_directory(path, ec) || ec)
             ErThrow(Er::Util::format("Failed to create %s: %s", m_cacheDir.c_str(), ec.message().c_str()));
     }
+
+    if (params.storeFormat == StoreFormat::Pack)
+    {
+        m_store = createPackStore(m_log, m_cacheDir);
+        m_spill = createFileStore(m_log, m_cacheDir, m_icoFormat);
+    }
+    else
+        m_store = createFileStore(m_log, m_cacheDir, m_icoFormat);
+
+    m_rechecker = std::jthread([this](std::stop_token stop) { rechecker(stop); });
 }
 
 IconCache::IconInfo IconCache::cacheIcon(std::string_view name, unsigned size) noexcept
 {
-    std::filesystem::path path(name);
-    if (path.is_absolute())
-        return cacheIconFromAbsolutePath(name, size);
-    else
-        return cacheIconFromName(name, size);
+    try
+    {
+        m_requests.fetch_add(1, std::memory_order_relaxed);
+
+        // no syscalls at all for names we've already answered
+        LruKey key(name, size);
+        auto cached = m_lru.find(key);
+
+        maybeLogStats();
+
+        if (cached)
+        {
+            // keeps it from being evicted from the disk
+            if (m_diskBudget)
+                m_store->touch(name, size);
+
+            return *cached;
+        }
+
+        auto negative = m_negative.check(name, size);
+        if (negative == NegativeCache::Result::Missing)
+        {
+            m_negativeHits.fetch_add(1, std::memory_order_relaxed);
+            return IconInfo(IconInfo::Type::Invalid);
+        }
+
+        if (negative == NegativeCache::Result::Suspected)
+        {
+            // it was missing before the restart; answer now and verify in the background
+            auto stored = m_store->find(name, size);
+            if (stored && (stored->type == IconInfo::Type::Valid))
+            {
+                m_lru.insert(key, *stored);
+                return *stored;
+            }
+
+            m_negative.add(name, size);
+
+            {
+                std::lock_guard l(m_suspectedMutex);
+                m_suspected.push_back(NegativeCache::Key{ std::string(name), size });
+            }
+
+            m_recheckCv.notify_one();
+
+            return IconInfo(IconInfo::Type::Invalid);
+        }
+
+        return lookupIconOnce(key);
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+
+    return IconInfo(IconInfo::Type::Invalid);
 }
 
-bool IconCache::createEmptyFile(const std::string& path) noexcept
+IconCache::IconInfo IconCache::lookupIconOnce(const LruKey& key, bool siblings) noexcept
 {
-    auto fd = ::creat(path.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (fd < 0)
+    std::promise<IconInfo> promise;
+
     {
-        auto e = errno;
-        auto msg = Er::Util::posixErrorToString(e);
-        Er::Log::Error(m_log) << "Failed to create [" << path << "]: " << e << " " << msg;
-        return false;
+        std::unique_lock l(m_inFlightMutex);
+
+        auto it = m_inFlight.find(key);
+        if (it != m_inFlight.end())
+        {
+            // someone is already looking it up; wait for their result
+            auto future = it->second;
+            l.unlock();
+
+            m_coalesced.fetch_add(1, std::memory_order_relaxed);
+            return future.get();
+        }
+
+        m_inFlight.emplace(key, promise.get_future().share());
     }
 
-    ::close(fd);
-    return true;
+    auto info = lookupIcon(key.name, key.size, siblings);
+    if (info.type == IconInfo::Type::Valid)
+        m_lru.insert(key, info);
+
+    // the LRU is updated before the waiters are released and the key is removed,
+    // so late arrivals find it there
+    promise.set_value(info);
+
+    {
+        std::lock_guard l(m_inFlightMutex);
+        m_inFlight.erase(key);
+    }
+
+    return info;
 }
 
-IconCache::IconInfo IconCache::cacheIconFromAbsolutePath(std::string_view path, unsigned size) noexcept
+void IconCache::maybeLogStats() noexcept
 {
-    auto iconFilePath = Er::Desktop::makeIconCachePath(m_cacheDir, std::string(path), size, m_icoFormat);
+    auto now = Clock::now().time_since_epoch().count();
+    auto last = m_lastStatsLogged.load(std::memory_order_relaxed);
+    auto interval = std::chrono::duration_cast<Clock::duration>(StatsInterval).count();
 
-    if (std::filesystem::exists(iconFilePath))
+    if ((now - last >= interval) && m_lastStatsLogged.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        logStats();
+}
+
+void IconCache::logStats() noexcept
+{
+    auto stats = m_lru.stats();
+    auto total = stats.hits + stats.misses;
+    if (!total)
+        return;
+
+    Er::Log::Info(m_log) << "LRU: " << stats.size << " entries, " << stats.hits << " hits, " << stats.misses << " misses, hit ratio " << (stats.hits * 100.0 / total) << "%, " << m_coalesced.load(std::memory_order_relaxed) << " coalesced lookups";
+}
+
+void IconCache::rechecker(std::stop_token stop) noexcept
+{
+    Er::System::CurrentThread::setName("iconcache_recheck");
+
+    try
     {
-        struct stat fs = {};
-        if (::stat(iconFilePath.c_str(), &fs) == 0)
+        auto lastRecheck = Clock::now();
+
+        while (!stop.stop_requested())
         {
-            if (fs.st_size == 0)
+            std::vector<NegativeCache::Key> keys;
+            std::vector<LruKey> siblings;
+
             {
-                Er::Log::Debug(m_log) << "Found NULL cached icon [" << path << "] for [" << iconFilePath << "]";
-                return IconInfo(IconInfo::Type::Invalid);
+                // suspected icons and the other sizes of new ones are taken care of right away
+                std::unique_lock l(m_suspectedMutex);
+                m_recheckCv.wait_for(l, stop, PublishInterval, [this]() { return !m_suspected.empty() || !m_siblings.empty(); });
+                if (stop.stop_requested())
+                    break;
+
+                keys.swap(m_suspected);
+                siblings.swap(m_siblings);
             }
 
-            Er::Log::Debug(m_log) << "Found cached icon [" << path << "] at [" << iconFilePath << "]";
-            return IconInfo(IconInfo::Type::Valid, iconFilePath);
+            for (auto& k : siblings)
+            {
+                if (stop.stop_requested())
+                    break;
+
+                rasterizeSiblings(k.name, k.size);
+            }
+
+            // the store only appends while serving; its index is written here
+            m_store->flush();
+
+            auto now = Clock::now();
+            if (now - lastRecheck >= RecheckInterval)
+            {
+                lastRecheck = now;
+
+                // new icons may have been installed
+                if (m_themeIndex->refreshIfChanged())
+                    m_negative.clear();
+
+                maintainStore();
+
+                auto expired = m_negative.takeExpired();
+                keys.insert(keys.end(), std::make_move_iterator(expired.begin()), std::make_move_iterator(expired.end()));
+            }
+
+            if (keys.empty())
+                continue;
+
+            std::size_t found = 0;
+            for (auto& k : keys)
+            {
+                if (stop.stop_requested())
+                    break;
+
+                m_negative.remove(k.name, k.size);
+
+                // re-adds it to the negative cache if it's still missing
+                auto info = lookupIcon(k.name, k.size);
+                if (info.type == IconInfo::Type::Valid)
+                {
+                    m_lru.insert(LruKey(k.name, k.size), info);
+                    ++found;
+                }
+            }
+
+            Er::Log::Debug(m_log) << "Rechecked " << keys.size() << " missing icons, " << found << " found now";
         }
     }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+void IconCache::maintainStore() noexcept
+{
+    try
+    {
+        std::vector<IIconStore::Key> removed;
+        auto generation = m_store->generation();
+
+        // icons cached from absolute paths outlive the (often versioned) application directories they came from
+        auto now = Clock::now();
+        if (now - m_lastCompaction >= CompactionInterval)
+        {
+            m_lastCompaction = now;
+
+            auto stale = m_store->removeIf(
+                [](std::string_view name)
+                {
+                    if (name.empty() || (name.front() != '/'))
+                        return false;
+
+                    std::error_code ec;
+                    return !std::filesystem::exists(std::filesystem::path(name), ec) && !ec;
+                });
+
+            if (!stale.empty())
+            {
+                Er::Log::Info(m_log) << "Removed " << stale.size() << " cached icons whose source files are gone";
+
+                m_diskStaleRemoved.fetch_add(stale.size(), std::memory_order_relaxed);
+                removed.insert(removed.end(), std::make_move_iterator(stale.begin()), std::make_move_iterator(stale.end()));
+            }
+        }
+
+        // evict a bit more than necessary so that it doesn't happen on every pass
+        if (m_diskBudget && (m_store->diskUsage() > m_diskBudget))
+        {
+            auto evicted = m_store->evict(m_diskBudget - m_diskBudget / 10);
+
+            m_diskEvicted.fetch_add(evicted.size(), std::memory_order_relaxed);
+            removed.insert(removed.end(), std::make_move_iterator(evicted.begin()), std::make_move_iterator(evicted.end()));
+        }
+
+        // the LRU must not hand out paths that are gone
+        if (m_store->generation() != generation)
+        {
+            // the pack has been compacted and every reference into it has moved
+            m_lru.clear();
+        }
+        else
+        {
+            for (auto& k : removed)
+                m_lru.erase(LruKey(k.name, k.size));
+        }
+
+        // nor should the files copied out of the pack outlive the icons there
+        if (m_spill && !removed.empty())
+        {
+            std::unordered_set<std::string> names;
+            for (auto& k : removed)
+                names.insert(k.name);
+
+            m_spill->removeIf([&names](std::string_view name) { return names.contains(std::string(name)); });
+        }
+
+        m_store->flush();
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+IconCache::IconInfo IconCache::lookupIcon(std::string_view name, unsigned size, bool siblings) noexcept
+{
+    std::filesystem::path path(name);
+    if (path.is_absolute())
+        return cacheIconFromAbsolutePath(name, size);
+    else
+        return cacheIconFromName(name, size, siblings);
+}
+
+void IconCache::rasterizeSiblings(std::string_view name, unsigned size) noexcept
+{
+    try
+    {
+        std::size_t variants = 0;
+        for (auto other : m_sizeSet)
+        {
+            if ((other == size) || !other)
+                continue;
+
+            // whatever is in the LRU is in the store as well
+            auto stored = m_store->find(name, other);
+            if (stored && (stored->type == IconInfo::Type::Valid))
+                continue;
+
+            // joins a client's lookup of the same size instead of rasterizing it twice
+            auto variant = lookupIconOnce(LruKey(name, other), false);
+            if (variant.type == IconInfo::Type::Valid)
+            {
+                m_negative.remove(name, other);
+                ++variants;
+            }
+        }
+
+        if (variants)
+            Er::Log::Debug(m_log) << "Rasterized " << variants << " more sizes of [" << name << "]";
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+std::vector<std::string> IconCache::themeIconNames() const
+{
+    return m_themeIndex->names();
+}
+
+void IconCache::writeStats(std::ostream& out) const
+{
+    auto lru = m_lru.stats();
+
+    out << "cache_requests=" << m_requests.load(std::memory_order_relaxed) << "\n";
+    out << "cache_lru_hits=" << lru.hits << "\n";
+    out << "cache_lru_misses=" << lru.misses << "\n";
+    out << "cache_lru_size=" << lru.size << "\n";
+    out << "cache_negative_hits=" << m_negativeHits.load(std::memory_order_relaxed) << "\n";
+    out << "cache_negative_size=" << m_negative.size() << "\n";
+    out << "cache_coalesced=" << m_coalesced.load(std::memory_order_relaxed) << "\n";
+    out << "cache_disk_bytes=" << m_store->diskUsage() << "\n";
+    out << "cache_disk_budget_bytes=" << m_diskBudget << "\n";
+    out << "cache_disk_evicted=" << m_diskEvicted.load(std::memory_order_relaxed) << "\n";
+    out << "cache_disk_stale_removed=" << m_diskStaleRemoved.load(std::memory_order_relaxed) << "\n";
+    m_themeLookupTime.write(out, "cache_theme_lookup");
+    m_rasterizeTime.write(out, "cache_rasterize");
+}
+
+std::shared_ptr<const std::string> IconCache::iconData(std::string_view name, unsigned size, const IconInfo& info) noexcept
+{
+    if (info.type != IconInfo::Type::Valid)
+        return std::shared_ptr<const std::string>();
+
+    if (info.data)
+        return info.data;
+
+    try
+    {
+        auto data = m_store->read(name, size);
+        if (!data)
+            return std::shared_ptr<const std::string>();
+
+        auto withData = info;
+        withData.data = std::make_shared<const std::string>(std::move(*data));
+        m_lru.insert(LruKey(name, size), withData);
+
+        return withData.data;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+
+    return std::shared_ptr<const std::string>();
+}
+
+std::string IconCache::filePath(std::string_view name, unsigned size, const IconInfo& info) noexcept
+{
+    if (!m_spill)
+        return info.path;
+
+    try
+    {
+        auto spilled = m_spill->find(name, size);
+        if (spilled && (spilled->type == IconInfo::Type::Valid))
+            return spilled->path;
+
+        auto data = iconData(name, size, info);
+        if (!data)
+            return std::string();
+
+        auto stored = m_spill->put(name, size, *data);
+        if (stored.type == IconInfo::Type::Valid)
+            return stored.path;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+
+    return std::string();
+}
+
+IconCache::IconInfo IconCache::storePixmap(std::string_view name, unsigned size, const QPixmap& pixmap) noexcept
+{
+    QByteArray bytes;
+    bool encoded = false;
+    if (m_icoFormat == Erc::RawIcon::Extension)
+    {
+        bytes = Erc::RawIcon::encode(pixmap.toImage());
+        encoded = !bytes.isEmpty();
+    }
+    else
+    {
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+
+        // m_icoFormat is like '.png'
+        encoded = pixmap.save(&buffer, m_icoFormat.c_str() + 1);
+    }
+
+    if (!encoded)
+    {
+        m_negative.add(name, size);
+
+        Er::Log::Error(m_log) << "Icon [" << name << "] could not be encoded";
+        return IconInfo(IconInfo::Type::Invalid);
+    }
+
+    auto info = m_store->put(name, size, std::string_view(bytes.constData(), std::size_t(bytes.size())));
+    if (info.type == IconInfo::Type::Invalid)
+    {
+        m_negative.add(name, size);
+
+        Er::Log::Error(m_log) << "Icon [" << name << "] could not be saved";
+        return info;
+    }
+
+    // keep the bytes for clients that want them inline
+    info.data = std::make_shared<const std::string>(bytes.constData(), std::size_t(bytes.size()));
+
+    Er::Log::Info(m_log) << "Cached icon [" << name << "] to [" << info.path << "]";
+    return info;
+}
+
+IconCache::IconInfo IconCache::cacheIconFromAbsolutePath(std::string_view path, unsigned size) noexcept
+{
+    // stored negative results are not trusted; that's what the TTL is for
+    auto cached = m_store->find(path, size);
+    if (cached && (cached->type == IconInfo::Type::Valid))
+        return *cached;
 
     std::filesystem::path sourcePath(path);
     if (!std::filesystem::exists(sourcePath))
     {
-        createEmptyFile(iconFilePath);
+        m_negative.add(path, size);
 
         Er::Log::Error(m_log) << "Icon [" << path << "] does not exist";
         return IconInfo(IconInfo::Type::Invalid);
     }
 
+    auto started = Clock::now();
+
     QPixmap ico;
     if (!ico.load(QString::fromUtf8(path)))
     {
-        createEmptyFile(iconFilePath);
+        m_negative.add(path, size);
 
         Er::Log::Error(m_log) << "Icon [" << path << "] could not be loaded";
         return IconInfo(IconInfo::Type::Invalid);
     }
 
-    if (!ico.save(QString::fromUtf8(iconFilePath)))
-    {
-        createEmptyFile(iconFilePath);
-
-        Er::Log::Error(m_log) << "Icon [" << path << "] could not be saved to [" << iconFilePath << "]";
-        return IconInfo(IconInfo::Type::Invalid);
-    }
+    auto info = storePixmap(path, size, ico);
+    m_rasterizeTime.record(Clock::now() - started);
 
-    Er::Log::Info(m_log) << "Cached icon [" << path << "] to [" << iconFilePath << "]";
-    return IconInfo(IconInfo::Type::Valid, iconFilePath);
+    return info;
 }
 
-IconCache::IconInfo IconCache::cacheIconFromName(std::string_view name, unsigned size) noexcept
+IconCache::IconInfo IconCache::cacheIconFromName(std::string_view name, unsigned size, bool siblings) noexcept
 {
-    auto iconFilePath = Er::Desktop::makeIconCachePath(m_cacheDir, std::string(name), size, m_icoFormat);
-
-    if (std::filesystem::exists(iconFilePath))
+    auto cached = m_store->find(name, size);
+    if (cached && (cached->type == IconInfo::Type::Valid))
+        return *cached;
+
+    // the index may pick a different file for every size; QIcon::fromTheme() is
+    // only used if there's no index for the current theme
+    QIcon ico;
+    auto started = Clock::now();
+    if (m_themeIndex->valid())
     {
-        struct stat fs = {};
-        if (::stat(iconFilePath.c_str(), &fs) == 0)
-        {
-            if (fs.st_size == 0)
-            {
-                Er::Log::Debug(m_log) << "Found NULL cached icon [" << name << "] at [" << iconFilePath << "]";
-                return IconInfo(IconInfo::Type::Invalid);
-            }
-
-            Er::Log::Debug(m_log) << "Found cached icon [" << name << "] at [" << iconFilePath << "]";
-            return IconInfo(IconInfo::Type::Valid, iconFilePath);
-        }
+        auto path = m_themeIndex->lookup(name, size);
+        if (path)
+            ico = QIcon(QString::fromUtf8(*path));
+    }
+    else
+    {
+        ico = QIcon::fromTheme(QString::fromUtf8(name));
     }
 
-    auto ico = QIcon::fromTheme(QString::fromUtf8(name));
+    auto resolved = Clock::now();
+    m_themeLookupTime.record(resolved - started);
+
     if (ico.isNull())
     {
-        createEmptyFile(iconFilePath);
+        m_negative.add(name, size);
 
         Er::Log::Error(m_log) << "Icon [" << name << "] could not be loaded from current theme";
         return IconInfo(IconInfo::Type::Invalid);
     }
 
     auto pixmap = ico.pixmap(int(size));
+    auto info = storePixmap(name, size, pixmap);
+    m_rasterizeTime.record(Clock::now() - resolved);
 
-    if (!pixmap.save(QString::fromUtf8(iconFilePath)))
+    // clients are likely to ask for the other sizes soon; rasterize them after
+    // this one has been answered, so that they end up stored next to each other
+    if (siblings && (info.type == IconInfo::Type::Valid) && (m_sizeSet.size() > 1))
     {
-        createEmptyFile(iconFilePath);
+        {
+            std::lock_guard l(m_suspectedMutex);
+            m_siblings.emplace_back(name, size);
+        }
 
-        Er::Log::Error(m_log) << "Icon [" << name << "] could not be saved to [" << iconFilePath << "]";
-        return IconInfo(IconInfo::Type::Invalid);
+        m_recheckCv.notify_one();
     }
 
-    Er::Log::Info(m_log) << "Cached icon [" << name << "] to [" << iconFilePath << "]";
-    return IconInfo(IconInfo::Type::Valid, iconFilePath);
+    return info;
 }
 
 
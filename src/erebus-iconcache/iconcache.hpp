@@ -1,9 +1,25 @@
 #pragma once
 
+#include "iconstore.hpp"
+#include "lru.hpp"
+#include "negcache.hpp"
+#include "stats.hpp"
+#include "themeindex.hpp"
+
 #include <erebus/log.hxx>
 
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
+#include <future>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QPixmap>
 
 
 namespace Erp
@@ -17,33 +33,111 @@ class IconCache final
     : public Er::NonCopyable
 {
 public:
-    struct IconInfo
-    {
-        enum class Type
-        {
-            Valid,
-            Invalid
-        };
-
-        Type type;
-        std::string path;
+    using IconInfo = ::Erp::IconCache::IconInfo;
+    using StoreFormat = IIconStore::Format;
 
-        IconInfo(Type type) : type(type) {}
-        IconInfo(Type type, std::string_view path) : type(type), path(path) {}
+    struct Params
+    {
+        std::string icoFormat = ".png"; // or Erc::RawIcon::Extension
+        std::size_t lruCapacity = 4096;
+        StoreFormat storeFormat = StoreFormat::Files;
+        std::chrono::seconds negativeTtl = std::chrono::hours(1);
+        std::vector<unsigned> sizeSet = { 16, 24, 32, 48, 64 }; // rasterized together on a theme lookup
+        uint64_t diskBudget = 0; // bytes; 0 means unlimited
     };
 
-    IconCache(Er::Log::ILog* log, std::string_view themeName, std::string_view cacheDir, std::string_view icoFormat = ".png");
+    ~IconCache();
+    IconCache(Er::Log::ILog* log, std::string_view themeName, std::string_view cacheDir, const Params& params);
 
     IconInfo cacheIcon(std::string_view name, unsigned size) noexcept;
 
+    // every name known to the current theme and the themes it inherits
+    std::vector<std::string> themeIconNames() const;
+
+    // key=value lines for StatsReporter
+    void writeStats(std::ostream& out) const;
+
+    // the encoded bytes of a valid icon returned by cacheIcon(); read from the store
+    // at most once, then kept in memory along with the LRU entry
+    std::shared_ptr<const std::string> iconData(std::string_view name, unsigned size, const IconInfo& info) noexcept;
+
+    // a real file with the icon for consumers that don't understand pack references;
+    // in pack mode the icon is copied out of the pack the first time it's asked for;
+    // empty on failure
+    std::string filePath(std::string_view name, unsigned size, const IconInfo& info) noexcept;
+
+    bool packed() const noexcept
+    {
+        return !!m_spill;
+    }
+
 private:
+    struct LruKey
+    {
+        std::string name;
+        unsigned size;
+
+        LruKey(std::string_view name, unsigned size) : name(name), size(size) {}
+
+        bool operator==(const LruKey& o) const noexcept
+        {
+            return (size == o.size) && (name == o.name);
+        }
+    };
+
+    struct LruKeyHash
+    {
+        std::size_t operator()(const LruKey& k) const noexcept
+        {
+            return std::hash<std::string>{}(k.name) ^ (std::size_t(k.size) * 0x9e3779b97f4a7c15ULL);
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::seconds StatsInterval = std::chrono::seconds(60);
+
+    static constexpr std::chrono::seconds PublishInterval = std::chrono::seconds(5);
+    static constexpr std::chrono::seconds RecheckInterval = std::chrono::seconds(60);
+    static constexpr std::chrono::hours CompactionInterval = std::chrono::hours(6);
+
+    // 'siblings' has the rest of m_sizeSet rasterized in the background after a theme lookup
+    IconInfo lookupIcon(std::string_view name, unsigned size, bool siblings = true) noexcept;
+    IconInfo lookupIconOnce(const LruKey& key, bool siblings = true) noexcept;
+    void rechecker(std::stop_token stop) noexcept;
+    void rasterizeSiblings(std::string_view name, unsigned size) noexcept;
+    void maintainStore() noexcept;
+    void maybeLogStats() noexcept;
+    void logStats() noexcept;
     IconInfo cacheIconFromAbsolutePath(std::string_view path, unsigned size) noexcept;
-    IconInfo cacheIconFromName(std::string_view name, unsigned size) noexcept;
-    bool createEmptyFile(const std::string& path) noexcept;
+    IconInfo cacheIconFromName(std::string_view name, unsigned size, bool siblings) noexcept;
+    IconInfo storePixmap(std::string_view name, unsigned size, const QPixmap& pixmap) noexcept;
 
     Er::Log::ILog* m_log;
     std::string m_cacheDir;
     std::string m_icoFormat;
+    const std::vector<unsigned> m_sizeSet;
+    const uint64_t m_diskBudget;
+    std::unique_ptr<IIconStore> m_store;
+    std::unique_ptr<IIconStore> m_spill; // files copied out of the pack, if m_store is one
+    std::unique_ptr<ThemeIndex> m_themeIndex;
+    ShardedLru<LruKey, IconInfo, LruKeyHash> m_lru; // (name, size) -> valid icon
+    NegativeCache m_negative;
+    std::atomic<Clock::rep> m_lastStatsLogged;
+    std::mutex m_inFlightMutex;
+    std::unordered_map<LruKey, std::shared_future<IconInfo>, LruKeyHash> m_inFlight; // lookups being done right now
+    std::atomic<uint64_t> m_coalesced = 0; // requests that waited for someone else's lookup
+    std::atomic<uint64_t> m_requests = 0;
+    std::atomic<uint64_t> m_negativeHits = 0;
+    Histogram m_themeLookupTime;
+    Histogram m_rasterizeTime; // rasterize, encode and save
+    std::mutex m_suspectedMutex; // guards m_siblings as well
+    std::condition_variable_any m_recheckCv;
+    std::vector<NegativeCache::Key> m_suspected; // to be verified in the background
+    std::vector<LruKey> m_siblings; // icons whose other sizes are to be rasterized in the background
+    Clock::time_point m_lastCompaction; // owned by the rechecker thread
+    std::atomic<uint64_t> m_diskEvicted = 0;
+    std::atomic<uint64_t> m_diskStaleRemoved = 0;
+    std::jthread m_rechecker;
 };
 
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+struct IconInfo
+{
+    enum class Type
+    {
+        Valid,
+        Invalid
+    };
+
+    Type type;
+    std::string path;
+    std::shared_ptr<const std::string> data; // the encoded icon if it's already in memory
+
+    IconInfo(Type type) : type(type) {}
+    IconInfo(Type type, std::string_view path) : type(type), path(path) {}
+};
+
+
+//
+// where rasterized icons and negative results are kept on disk
+//
+
+struct IIconStore
+{
+    enum class Format
+    {
+        Files, // one file per (name, size)
+        Pack   // append-only pack file + hash index
+    };
+
+    struct Key
+    {
+        std::string name;
+        unsigned size;
+    };
+
+    virtual ~IIconStore() {}
+
+    // std::nullopt if this (name, size) has never been stored
+    virtual std::optional<IconInfo> find(std::string_view name, unsigned size) noexcept = 0;
+
+    // 'data' is the encoded icon
+    // negative results are not stored here, see NegativeCache
+    virtual IconInfo put(std::string_view name, unsigned size, std::string_view data) noexcept = 0;
+
+    // the encoded icon previously passed to put()
+    virtual std::optional<std::string> read(std::string_view name, unsigned size) noexcept = 0;
+
+    // marks (name, size) as just used; no syscalls, so it can be called on every request
+    virtual void touch(std::string_view name, unsigned size) noexcept = 0;
+
+    // bytes the store takes on disk, including any space not reclaimed yet
+    virtual uint64_t diskUsage() const noexcept = 0;
+
+    // changes whenever paths returned earlier may have gone stale without their icons being removed
+    virtual uint64_t generation() const noexcept = 0;
+
+    // removes the least recently used icons (and reclaims their space) until diskUsage() <= budget
+    virtual std::vector<Key> evict(uint64_t budget) noexcept = 0;
+
+    // removes the icons whose name 'stale' returns true for; 'stale' is called without locks held
+    virtual std::vector<Key> removeIf(const std::function<bool(std::string_view name)>& stale) noexcept = 0;
+
+    // writes out what put() only recorded in memory; called periodically off the serving path
+    virtual void flush() noexcept = 0;
+};
+
+
+std::unique_ptr<IIconStore> createFileStore(Er::Log::ILog* log, std::string_view cacheDir, std::string_view icoFormat);
+std::unique_ptr<IIconStore> createPackStore(Er::Log::ILog* log, std::string_view cacheDir);
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
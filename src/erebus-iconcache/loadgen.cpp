@@ -0,0 +1,283 @@
+#include "loadgen.hpp"
+
+#include <erebus/system/thread.hxx>
+
+#include <algorithm>
+#include <thread>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+LoadGenerator::LoadGenerator(Er::Log::ILog* log, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, const Workload& workload)
+    : m_log(log)
+    , m_ipc(ipc)
+    , m_workload(workload)
+    , m_random(workload.seed)
+    , m_nonce(uint64_t(Clock::now().time_since_epoch().count()))
+{
+}
+
+std::string LoadGenerator::makeKey(std::string_view name, unsigned size)
+{
+    std::string key(name);
+    key.push_back('\0');
+    key.append(std::to_string(size));
+    return key;
+}
+
+LoadGenerator::Request LoadGenerator::next()
+{
+    std::uniform_real_distribution<double> ratio(0.0, 1.0);
+    auto size = m_workload.sizes[std::uniform_int_distribution<std::size_t>(0, m_workload.sizes.size() - 1)(m_random)];
+    bool path = !m_workload.paths.empty() && ((m_workload.names.empty() || (ratio(m_random) < m_workload.pathRatio)));
+
+    std::string name;
+    if (ratio(m_random) < m_workload.missRatio)
+    {
+        // never seen before, so neither the LRU nor the negative cache can answer it
+        auto n = std::to_string(m_nonce) + "-" + std::to_string(++m_missCounter);
+        name = path ? ("/nonexistent/erebus-bench-" + n + ".png") : ("erebus-bench-missing-" + n);
+    }
+    else
+    {
+        auto& from = path ? m_workload.paths : m_workload.names;
+        name = from[std::uniform_int_distribution<std::size_t>(0, from.size() - 1)(m_random)];
+    }
+
+    return Request{ Protocol::makeRequestName(m_workload.mode, name), size };
+}
+
+bool LoadGenerator::warmUp(std::chrono::seconds timeout)
+{
+    std::vector<Request> requests;
+    for (auto size : m_workload.sizes)
+    {
+        for (auto& name : m_workload.names)
+            requests.push_back(Request{ Protocol::makeRequestName(m_workload.mode, name), size });
+
+        for (auto& path : m_workload.paths)
+            requests.push_back(Request{ Protocol::makeRequestName(m_workload.mode, path), size });
+    }
+
+    Er::Log::Info(m_log) << "Warming up with " << requests.size() << " requests";
+
+    std::size_t i = 0;
+    auto result = replay(
+        [&requests, &i]() -> std::optional<Request>
+        {
+            if (i >= requests.size())
+                return std::nullopt;
+
+            return requests[i++];
+        },
+        0,
+        timeout);
+
+    Er::Log::Info(m_log) << "Warmed up in " << result.seconds << " s, " << result.notFound << " not found, " << result.timedOut << " timed out, " << result.lost << " not answered";
+
+    return (result.received > 0) || requests.empty();
+}
+
+LoadGenerator::Result LoadGenerator::run()
+{
+    auto end = Clock::now() + m_workload.duration;
+
+    return replay(
+        [this, end]() -> std::optional<Request>
+        {
+            if (Clock::now() >= end)
+                return std::nullopt;
+
+            return next();
+        },
+        m_workload.rate,
+        m_workload.drainTimeout);
+}
+
+LoadGenerator::Result LoadGenerator::replay(const std::function<std::optional<Request>()>& source, unsigned rate, std::chrono::seconds drainTimeout)
+{
+    {
+        std::lock_guard l(m_mutex);
+        m_pending.clear();
+        m_inFlight = 0;
+        m_sending = true;
+        m_drainDeadline = Clock::time_point::max();
+        m_received = 0;
+        m_notFound = 0;
+        m_timedOut = 0;
+        m_latenciesUs.clear();
+    }
+
+    Result result;
+    auto started = Clock::now();
+    m_lastReceived = started;
+
+    std::thread receiver([this]() { receive(); });
+
+    auto period = rate ? std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / rate : Clock::duration::zero();
+    for (;;)
+    {
+        auto request = source();
+        if (!request)
+            break;
+
+        // the schedule doesn't slip when the daemon is slow; the latency does
+        auto due = rate ? (started + period * int64_t(result.sent)) : Clock::now();
+        if (rate)
+            std::this_thread::sleep_until(due);
+
+        {
+            // a request the daemon has dropped must not keep its slot forever
+            std::unique_lock l(m_mutex);
+            while (m_inFlight >= m_workload.window)
+            {
+                auto deadline = expire(Clock::now());
+                if (m_inFlight < m_workload.window)
+                    break;
+
+                m_windowCv.wait_until(l, deadline);
+            }
+
+            m_pending[makeKey(request->name, request->size)].push_back(due);
+            ++m_inFlight;
+        }
+
+        if (!m_ipc->requestIcon(Er::Desktop::IIconCacheIpc::IconRequest(request->name, request->size), Timeout))
+        {
+            Er::Log::Warning(m_log) << "Failed to send a request for [" << request->name << "]";
+
+            std::lock_guard l(m_mutex);
+            m_pending[makeKey(request->name, request->size)].pop_back();
+            --m_inFlight;
+            continue;
+        }
+
+        ++result.sent;
+    }
+
+    {
+        std::lock_guard l(m_mutex);
+        m_sending = false;
+        m_drainDeadline = Clock::now() + drainTimeout;
+    }
+
+    receiver.join();
+
+    std::lock_guard l(m_mutex);
+
+    result.received = m_received;
+    result.notFound = m_notFound;
+    result.timedOut = m_timedOut;
+    result.lost = m_inFlight;
+    result.seconds = std::chrono::duration<double>(m_lastReceived - started).count();
+
+    std::sort(m_latenciesUs.begin(), m_latenciesUs.end());
+    auto percentile = [this](double p) -> double
+    {
+        if (m_latenciesUs.empty())
+            return 0.0;
+
+        auto i = std::min(m_latenciesUs.size() - 1, std::size_t(p * double(m_latenciesUs.size())));
+        return m_latenciesUs[i];
+    };
+
+    result.p50Us = percentile(0.50);
+    result.p90Us = percentile(0.90);
+    result.p99Us = percentile(0.99);
+    result.maxUs = m_latenciesUs.empty() ? 0.0 : m_latenciesUs.back();
+
+    return result;
+}
+
+void LoadGenerator::receive() noexcept
+{
+    Er::System::CurrentThread::setName("bench_receive");
+
+    try
+    {
+        for (;;)
+        {
+            {
+                std::lock_guard l(m_mutex);
+                if (!m_sending && (!m_inFlight || (Clock::now() >= m_drainDeadline)))
+                    break;
+            }
+
+            auto response = m_ipc->pullIcon(Timeout);
+            if (!response)
+                continue;
+
+            auto now = Clock::now();
+
+            std::lock_guard l(m_mutex);
+
+            // with several workers, requests for the same (name, size) may be answered
+            // out of order; attributing the response to the oldest one is close enough
+            auto it = m_pending.find(makeKey(response->name, response->size));
+            if ((it == m_pending.end()) || it->second.empty())
+            {
+                // unless it's a late answer to a request that has timed out
+                if (!m_timedOut)
+                    Er::Log::Warning(m_log) << "Unexpected response for [" << response->name << "]";
+
+                continue;
+            }
+
+            m_latenciesUs.push_back(std::chrono::duration<double, std::micro>(now - it->second.front()).count());
+            it->second.pop_front();
+            if (it->second.empty())
+                m_pending.erase(it);
+
+            ++m_received;
+            if (response->result != Er::Desktop::IIconCacheIpc::IconResponse::Result::Ok)
+                ++m_notFound;
+
+            --m_inFlight;
+            m_lastReceived = now;
+            m_windowCv.notify_one();
+        }
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+LoadGenerator::Clock::time_point LoadGenerator::expire(Clock::time_point now)
+{
+    // m_mutex is held by the caller; returns when the next pending request times out
+    auto next = Clock::time_point::max();
+
+    for (auto it = m_pending.begin(); it != m_pending.end();)
+    {
+        // requests are sent in the order they're due
+        auto& due = it->second;
+        while (!due.empty() && (due.front() + m_workload.requestTimeout <= now))
+        {
+            due.pop_front();
+            ++m_timedOut;
+            --m_inFlight;
+        }
+
+        if (due.empty())
+        {
+            it = m_pending.erase(it);
+            continue;
+        }
+
+        next = std::min(next, due.front() + m_workload.requestTimeout);
+        ++it;
+    }
+
+    return next;
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
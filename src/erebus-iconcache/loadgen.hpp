@@ -0,0 +1,125 @@
+#pragma once
+
+#include "protocol.hpp"
+
+#include <erebus/log.hxx>
+#include <erebus-desktop/ic.hxx>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// replays a synthetic request mix against a running daemon over its message queues
+//
+// Requests are sent open-loop at a fixed rate (bounded by the number of requests
+// in flight) and latency is measured from the moment a request was due, so
+// a daemon falling behind shows up as latency rather than as a lower send rate.
+//
+
+class LoadGenerator final
+    : public Er::NonCopyable
+{
+public:
+    struct Workload
+    {
+        std::vector<std::string> names;  // theme icon names
+        std::vector<std::string> paths;  // absolute icon file paths
+        std::vector<unsigned> sizes = { 16 };
+        double pathRatio = 0.2;          // of the requests that are expected to hit
+        double missRatio = 0.1;          // names and paths that don't exist, each one unique
+        Protocol::ResponseMode mode = Protocol::ResponseMode::Path;
+        unsigned rate = 1000;            // requests/sec; 0 means as fast as the window allows
+        unsigned window = 256;           // max requests in flight
+        std::chrono::milliseconds requestTimeout = std::chrono::milliseconds(2000); // from when a request was due; it leaves the window then
+        std::chrono::seconds duration = std::chrono::seconds(10);
+        std::chrono::seconds drainTimeout = std::chrono::seconds(5); // for the responses still in flight
+        uint32_t seed = 1;
+    };
+
+    struct Result
+    {
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        uint64_t notFound = 0;
+        uint64_t timedOut = 0; // not answered within requestTimeout
+        uint64_t lost = 0;   // never answered
+        double seconds = 0.0; // from the first request to the last response
+        double p50Us = 0.0;
+        double p90Us = 0.0;
+        double p99Us = 0.0;
+        double maxUs = 0.0;
+
+        double throughput() const noexcept
+        {
+            return (seconds > 0.0) ? (double(received) / seconds) : 0.0;
+        }
+    };
+
+    explicit LoadGenerator(Er::Log::ILog* log, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, const Workload& workload);
+
+    // requests every existing name and path at every size once, so that the measured
+    // run sees hits where it's supposed to; false if the daemon doesn't answer
+    bool warmUp(std::chrono::seconds timeout);
+
+    Result run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds Timeout = std::chrono::milliseconds(100);
+
+    struct Request
+    {
+        std::string name; // as sent, with the mode prefix
+        unsigned size;
+    };
+
+    // 'source' returns std::nullopt when there's nothing more to send
+    Result replay(const std::function<std::optional<Request>()>& source, unsigned rate, std::chrono::seconds drainTimeout);
+    Request next();
+    void receive() noexcept;
+    Clock::time_point expire(Clock::time_point now);
+
+    static std::string makeKey(std::string_view name, unsigned size);
+
+    Er::Log::ILog* const m_log;
+    std::shared_ptr<Er::Desktop::IIconCacheIpc> m_ipc;
+    const Workload m_workload;
+    std::mt19937 m_random;
+    const uint64_t m_nonce; // keeps missing names unique across runs against the same daemon
+    uint64_t m_missCounter = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_windowCv;
+    std::unordered_map<std::string, std::deque<Clock::time_point>> m_pending; // (name, size) -> when the requests were due
+    std::size_t m_inFlight = 0;
+    bool m_sending = false;
+    Clock::time_point m_drainDeadline;
+    uint64_t m_received = 0;
+    uint64_t m_notFound = 0;
+    uint64_t m_timedOut = 0;
+    Clock::time_point m_lastReceived;
+    std::vector<double> m_latenciesUs;
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
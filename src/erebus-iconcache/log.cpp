@@ -1,9 +1,8 @@
 #include "log.hpp"
 
-#include <erebus/syncstream.hxx>
 #include <erebus/util/utf16.hxx>
 
-#include <iostream>
+#include <cstring>
 
 
 namespace Erp
@@ -50,14 +49,13 @@ void Log::delegate(std::shared_ptr<Er::Log::Record> r)
         strLevel
     );
 
-    std::string message = std::string(prefix);
+    std::string message;
+    message.reserve(std::strlen(prefix) + r->message.size() + 1);
+    message.append(prefix);
     message.append(r->message);
     message.append("\n");
 
-    if (r->level < Er::Log::Level::Error)
-        Er::osyncstream(std::cout) << message;
-    else
-        Er::osyncstream(std::cerr) << message;
+    m_sink.write(std::move(message), r->level >= Er::Log::Level::Error);
 }
 
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "consolesink.hpp"
+
 #include <erebus/log.hxx>
 
 namespace Erp
@@ -18,6 +20,8 @@ public:
 
 private:
     void delegate(std::shared_ptr<Er::Log::Record> r);
+
+    ConsoleSink m_sink;
 };
 
 
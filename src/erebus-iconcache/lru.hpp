@@ -0,0 +1,168 @@
+#pragma once
+
+#include <erebus/erebus.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// thread-safe LRU map split into independently locked shards
+//
+
+template <typename KeyT, typename ValueT, typename HashT = std::hash<KeyT>>
+class ShardedLru final
+    : public Er::NonCopyable
+{
+public:
+    using Key = KeyT;
+    using Value = ValueT;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        std::size_t size = 0;
+    };
+
+    explicit ShardedLru(std::size_t capacity, std::size_t shards = DefaultShards)
+        : m_shards(std::max<std::size_t>(shards, 1))
+    {
+        auto perShard = std::max<std::size_t>(capacity / m_shards.size(), 1);
+        for (auto& shard : m_shards)
+            shard.capacity = perShard;
+    }
+
+    std::optional<Value> find(const Key& key)
+    {
+        auto& shard = shardFor(key);
+        std::lock_guard l(shard.mutex);
+
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+        {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        // move to the front
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+
+    void insert(const Key& key, const Value& value)
+    {
+        auto& shard = shardFor(key);
+        std::lock_guard l(shard.mutex);
+
+        auto it = shard.map.find(key);
+        if (it != shard.map.end())
+        {
+            it->second->second = value;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return;
+        }
+
+        shard.lru.emplace_front(key, value);
+        try
+        {
+            shard.map.insert({ key, shard.lru.begin() });
+        }
+        catch (...)
+        {
+            shard.lru.pop_front();
+            throw;
+        }
+
+        while (shard.lru.size() > shard.capacity)
+        {
+            shard.map.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+        }
+    }
+
+    void erase(const Key& key)
+    {
+        auto& shard = shardFor(key);
+        std::lock_guard l(shard.mutex);
+
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+            return;
+
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+    }
+
+    void clear()
+    {
+        for (auto& shard : m_shards)
+        {
+            std::lock_guard l(shard.mutex);
+            shard.map.clear();
+            shard.lru.clear();
+        }
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.hits = m_hits.load(std::memory_order_relaxed);
+        s.misses = m_misses.load(std::memory_order_relaxed);
+
+        for (auto& shard : m_shards)
+        {
+            std::lock_guard l(shard.mutex);
+            s.size += shard.lru.size();
+        }
+
+        return s;
+    }
+
+    static constexpr std::size_t DefaultShards = 16;
+
+private:
+    using Entry = std::pair<Key, Value>;
+    using List = std::list<Entry>;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::size_t capacity = 0;
+        List lru; // most recently used first
+        std::unordered_map<Key, typename List::iterator, HashT> map;
+    };
+
+    Shard& shardFor(const Key& key)
+    {
+        // don't let the shard index correlate with the bucket index inside the shard
+        auto h = HashT{}(key);
+        h ^= (h >> 17);
+        h *= 0x9e3779b97f4a7c15ULL;
+        return m_shards[(h >> 32) % m_shards.size()];
+    }
+
+    std::vector<Shard> m_shards;
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
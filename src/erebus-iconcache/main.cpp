@@ -1,13 +1,21 @@
+#include "formatbench.hpp"
 #include "iconcache.hpp"
 #include "log.hpp"
+#include "packstore.hpp"
+#include "prewarm.hpp"
 #include "server.hpp"
+#include "shmarena.hpp"
+#include "stats.hpp"
 
 #include <erebus/condition.hxx>
 #include <erebus/util/signalhandler.hxx>
+#include <erebus-gui/rawicon.hpp>
 
 #include <QGuiApplication>
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -19,17 +27,32 @@ namespace
 
 Er::Event g_exitCondition(false);
 std::optional<int> g_signalReceived;
+std::stop_source g_stopSource;
+std::mutex g_statsMutex;
+Erp::IconCache::StatsReporter* g_statsReporter = nullptr;
 
-void signalHandler(int signo)
+// returns false to keep waiting for signals
+bool signalHandler(int signo)
 {
+    if (signo == SIGUSR1)
+    {
+        std::lock_guard l(g_statsMutex);
+        if (g_statsReporter)
+            g_statsReporter->requestDump();
+
+        return false;
+    }
+
     g_signalReceived = signo;
+    g_stopSource.request_stop();
     g_exitCondition.setAndNotifyAll(true);
+    return true;
 }
 
 
-void cacheIconsFromList(Er::Log::ILog* log, const std::string& cacheDir, const std::string& themeName, const std::vector<std::string>& requested, unsigned iconSize)
+void cacheIconsFromList(Er::Log::ILog* log, const std::string& cacheDir, const std::string& themeName, const std::vector<std::string>& requested, unsigned iconSize, const Erp::IconCache::IconCache::Params& params)
 {
-    Erp::IconCache::IconCache cache(log, themeName, cacheDir, ".png");
+    Erp::IconCache::IconCache cache(log, themeName, cacheDir, params);
 
     for (auto& req: requested)
     {
@@ -37,6 +60,22 @@ void cacheIconsFromList(Er::Log::ILog* log, const std::string& cacheDir, const s
     }
 }
 
+std::vector<unsigned> parseSizes(const std::string& list)
+{
+    std::vector<std::string> items;
+    boost::split(items, list, [](char c) { return (c == ':'); });
+
+    std::vector<unsigned> sizes;
+    for (auto& item : items)
+    {
+        auto n = std::strtoul(item.c_str(), nullptr, 10);
+        if (n > 0)
+            sizes.push_back(unsigned(n));
+    }
+
+    return sizes;
+}
+
 } // namespace {}
 
 
@@ -45,14 +84,13 @@ int main(int argc, char* argv[])
     // let the icon cache be accessible for all users
     ::umask(0);
 
-    Er::Util::SignalHandler sh({SIGINT, SIGTERM, SIGPIPE, SIGHUP});
+    Er::Util::SignalHandler sh({SIGINT, SIGTERM, SIGPIPE, SIGHUP, SIGUSR1});
     std::future<int> futureSigHandler =
         // spawn a thread that handles signals
         sh.asyncWaitHandler(
             [](int signo)
             {
-                signalHandler(signo);
-                return true;
+                return signalHandler(signo);
             }
         );
 
@@ -67,6 +105,22 @@ int main(int argc, char* argv[])
         std::vector<std::string> requestedIcons;
         unsigned iconSize = 0;
         std::string mqName;
+        std::size_t lruCapacity = 0;
+        unsigned workersMin = 0;
+        unsigned workersMax = 0;
+        unsigned batchSize = 0;
+        std::size_t inlineMax = 0;
+        std::size_t shmSize = 0;
+        std::string storeFormatName;
+        std::string icoFormatName;
+        unsigned benchCount = 0;
+        std::string statsFile;
+        unsigned statsInterval = 0;
+        unsigned negativeTtl = 0;
+        std::size_t cacheBudget = 0;
+        std::string prewarmSizes;
+        std::string sizeSet;
+        unsigned prewarmThreads = 0;
 
         namespace po = boost::program_options;
         po::options_description options("Command line options");
@@ -78,6 +132,24 @@ int main(int argc, char* argv[])
             ("size", po::value<unsigned>(&iconSize)->default_value(16), "icon size")
             ("icons", po::value<std::string>(&iconList), "requested icon names (colon-separated)")
             ("queue", po::value<std::string>(&mqName)->default_value("erebus"), "message queue name")
+            ("lru", po::value<std::size_t>(&lruCapacity)->default_value(Erp::IconCache::IconCache::Params().lruCapacity), "in-memory cache capacity (entries)")
+            ("workers-min", po::value<unsigned>(&workersMin)->default_value(1), "minimum number of server workers")
+            ("workers-max", po::value<unsigned>(&workersMax)->default_value(4), "maximum number of server workers")
+            ("batch", po::value<unsigned>(&batchSize)->default_value(16), "max requests handled per worker wakeup")
+            ("inline-max", po::value<std::size_t>(&inlineMax)->default_value(3 * 1024), "max icon size sent inline in a response (bytes); a response never exceeds 4 KB")
+            ("shm-size", po::value<std::size_t>(&shmSize)->default_value(16), "shared memory for icons (MB); 0 disables it")
+            ("store", po::value<std::string>(&storeFormatName)->default_value("files"), "on-disk format: 'files' or 'pack'")
+            ("format", po::value<std::string>(&icoFormatName)->default_value("png"), "icon encoding: 'png' or 'argb' (raw premultiplied ARGB32)")
+            ("bench-formats", po::value<unsigned>(&benchCount)->default_value(0), "compare png and argb on up to N icons (--icons or the theme index) at --size-set sizes, then exit")
+            ("stats-file", po::value<std::string>(&statsFile), "write statistics to this file periodically (key=value); SIGUSR1 logs them anyway")
+            ("stats-interval", po::value<unsigned>(&statsInterval)->default_value(10), "statistics file update interval (seconds)")
+            ("negative-ttl", po::value<unsigned>(&negativeTtl)->default_value(3600), "how long a missing icon is not looked up again (seconds)")
+            ("cache-budget", po::value<std::size_t>(&cacheBudget)->default_value(0), "on-disk cache size limit (MB); least recently used icons are evicted above it; 0 means unlimited")
+            ("compact", "compact the pack store and exit (the daemon must not be running)")
+            ("size-set", po::value<std::string>(&sizeSet)->default_value("16:24:32:48:64"), "sizes rasterized together when an icon is looked up (colon-separated)")
+            ("prewarm", "cache all icons referenced by .desktop files and the theme index, then exit")
+            ("prewarm-sizes", po::value<std::string>(&prewarmSizes), "icon sizes to prewarm (colon-separated); defaults to --size")
+            ("prewarm-threads", po::value<unsigned>(&prewarmThreads)->default_value(0), "prewarm threads; 0 means one per CPU")
         ;
 
         po::variables_map vm;
@@ -107,6 +179,66 @@ int main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
 
+        Erp::IconCache::IIconStore::Format storeFormat;
+        if (storeFormatName == "files")
+        {
+            storeFormat = Erp::IconCache::IIconStore::Format::Files;
+        }
+        else if (storeFormatName == "pack")
+        {
+            storeFormat = Erp::IconCache::IIconStore::Format::Pack;
+        }
+        else
+        {
+            std::cerr << "Unknown store format " << storeFormatName << "\n";
+            std::cerr << options << "\n";
+            return EXIT_FAILURE;
+        }
+
+        Erp::IconCache::IconCache::Params cacheParams;
+        if (icoFormatName == "png")
+        {
+            cacheParams.icoFormat = ".png";
+        }
+        else if (icoFormatName == "argb")
+        {
+            cacheParams.icoFormat = Erc::RawIcon::Extension;
+        }
+        else
+        {
+            std::cerr << "Unknown icon format " << icoFormatName << "\n";
+            std::cerr << options << "\n";
+            return EXIT_FAILURE;
+        }
+
+        cacheParams.lruCapacity = lruCapacity;
+        cacheParams.storeFormat = storeFormat;
+        cacheParams.negativeTtl = std::chrono::seconds(negativeTtl);
+        cacheParams.sizeSet = parseSizes(sizeSet);
+        cacheParams.diskBudget = uint64_t(cacheBudget) * 1024 * 1024;
+
+        if (vm.count("compact"))
+        {
+            return Erp::IconCache::compactPack(&console, cacheDir) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (benchCount > 0)
+        {
+            auto names = requestedIcons;
+            if (names.empty())
+            {
+                Erp::IconCache::IconCache cache(&console, themeName, cacheDir, cacheParams);
+                names = cache.themeIconNames();
+                std::sort(names.begin(), names.end());
+            }
+
+            if (names.size() > benchCount)
+                names.resize(benchCount);
+
+            Erp::IconCache::benchmarkFormats(&console, names, cacheParams.sizeSet);
+            return EXIT_SUCCESS;
+        }
+
         if (!requestedIcons.empty())
         {
             if (!iconSize)
@@ -116,10 +248,37 @@ int main(int argc, char* argv[])
                 return EXIT_FAILURE;
             }
 
-            cacheIconsFromList(&console, cacheDir, themeName, requestedIcons, iconSize);
+            cacheIconsFromList(&console, cacheDir, themeName, requestedIcons, iconSize, cacheParams);
             return EXIT_SUCCESS;
         }
 
+        if (vm.count("prewarm"))
+        {
+            Erp::IconCache::PrewarmParams prewarmParams;
+            prewarmParams.threads = prewarmThreads;
+
+            if (!prewarmSizes.empty())
+            {
+                prewarmParams.sizes = parseSizes(prewarmSizes);
+            }
+            else if (iconSize)
+            {
+                prewarmParams.sizes.push_back(iconSize);
+            }
+
+            if (prewarmParams.sizes.empty())
+            {
+                std::cerr << "Expected valid icon sizes\n";
+                std::cerr << options << "\n";
+                return EXIT_FAILURE;
+            }
+
+            Erp::IconCache::IconCache cache(&console, themeName, cacheDir, cacheParams);
+            Erp::IconCache::prewarm(&console, cache, prewarmParams, g_stopSource.get_token());
+
+            return g_signalReceived ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
         if (mqName.empty())
         {
             std::cerr << "Expected a message queue name\n";
@@ -127,6 +286,13 @@ int main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
 
+        if (!workersMin || (workersMax < workersMin))
+        {
+            std::cerr << "Expected 0 < workers-min <= workers-max\n";
+            std::cerr << options << "\n";
+            return EXIT_FAILURE;
+        }
+
         std::string mqIn(mqName);
         mqIn.append("_req");
         std::string mqOut(mqName);
@@ -136,12 +302,37 @@ int main(int argc, char* argv[])
         console.writef(Er::Log::Level::Info, "Opened message queue %s", mqIn.c_str());
         console.writef(Er::Log::Level::Info, "Opened message queue %s", mqOut.c_str());
 
-        Erp::IconCache::IconCache cache(&console, themeName, cacheDir, ".png");
+        Erp::IconCache::IconCache cache(&console, themeName, cacheDir, cacheParams);
+
+        std::unique_ptr<Erp::IconCache::ShmArena> arena;
+        if (shmSize > 0)
+        {
+            std::string shmName("/");
+            shmName.append(mqName);
+            shmName.append("_icons");
+
+            arena = std::make_unique<Erp::IconCache::ShmArena>(&console, shmName, shmSize * 1024 * 1024);
+        }
+
+        Erp::IconCache::IconServer server(&console, &g_exitCondition, ipc, cache, arena.get(), Erp::IconCache::IconServer::Params(workersMin, workersMax, batchSize, inlineMax));
 
-        Erp::IconCache::IconServer server(&console, &g_exitCondition, ipc, cache, 2);
+        std::vector<Erp::IconCache::StatsReporter::Source> statsSources;
+        statsSources.push_back([&server](std::ostream& out) { server.writeStats(out); });
+        statsSources.push_back([&cache](std::ostream& out) { cache.writeStats(out); });
+        Erp::IconCache::StatsReporter statsReporter(&console, std::move(statsSources), statsFile, std::chrono::seconds(std::max(statsInterval, 1U)));
+
+        {
+            std::lock_guard l(g_statsMutex);
+            g_statsReporter = &statsReporter;
+        }
 
         g_exitCondition.waitValue(true);
 
+        {
+            std::lock_guard l(g_statsMutex);
+            g_statsReporter = nullptr;
+        }
+
         if (g_signalReceived)
         {
             console.writef(Er::Log::Level::Warning, "Exiting due to signal %d", *g_signalReceived);
@@ -0,0 +1,230 @@
+#include "negcache.hpp"
+#include "packstore.hpp"
+
+#include <erebus/util/posixerror.hxx>
+
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+NegativeCache::~NegativeCache()
+{
+    save();
+}
+
+NegativeCache::NegativeCache(Er::Log::ILog* log, std::string_view cacheDir, std::chrono::seconds ttl)
+    : m_log(log)
+    , m_bloomPath((std::filesystem::path(cacheDir) / "negative.bloom").string())
+    , m_ttl(ttl)
+{
+    load();
+}
+
+std::string NegativeCache::makeKey(std::string_view name, unsigned size)
+{
+    std::string key(name);
+    key.push_back('\0');
+    key.append(std::to_string(size));
+    return key;
+}
+
+void NegativeCache::bloomPositions(std::string_view name, unsigned size, uint32_t (&positions)[BloomHashes]) noexcept
+{
+    // double hashing over a persisted (hence stable) hash
+    uint64_t h1 = Pack::hashKey(name, size);
+    uint64_t h2 = h1;
+    h2 ^= h2 >> 33;
+    h2 *= 0xff51afd7ed558ccdULL;
+    h2 ^= h2 >> 33;
+    h2 |= 1;
+
+    for (uint32_t i = 0; i < BloomHashes; ++i)
+        positions[i] = uint32_t((h1 + i * h2) % BloomBits);
+}
+
+NegativeCache::Result NegativeCache::check(std::string_view name, unsigned size)
+{
+    auto key = makeKey(name, size);
+
+    std::lock_guard l(m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+        return (it->second > Clock::now()) ? Result::Missing : Result::Unknown;
+
+    if (m_loaded.empty())
+        return Result::Unknown;
+
+    uint32_t positions[BloomHashes];
+    bloomPositions(name, size, positions);
+    for (auto bit : positions)
+    {
+        if (!(m_loaded[bit / 8] & (1U << (bit % 8))))
+            return Result::Unknown;
+    }
+
+    return Result::Suspected;
+}
+
+void NegativeCache::add(std::string_view name, unsigned size)
+{
+    auto key = makeKey(name, size);
+    auto expires = Clock::now() + m_ttl;
+
+    std::lock_guard l(m_mutex);
+    m_entries[key] = expires;
+}
+
+void NegativeCache::remove(std::string_view name, unsigned size)
+{
+    auto key = makeKey(name, size);
+
+    std::lock_guard l(m_mutex);
+    m_entries.erase(key);
+}
+
+void NegativeCache::clear()
+{
+    std::lock_guard l(m_mutex);
+    m_entries.clear();
+    m_loaded.clear();
+}
+
+std::vector<NegativeCache::Key> NegativeCache::takeExpired()
+{
+    std::vector<Key> expired;
+    auto now = Clock::now();
+
+    std::lock_guard l(m_mutex);
+
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (it->second <= now)
+        {
+            auto separator = it->first.find('\0');
+            expired.push_back(Key{ it->first.substr(0, separator), unsigned(std::stoul(it->first.substr(separator + 1))) });
+
+            it = m_entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return expired;
+}
+
+std::size_t NegativeCache::size() const
+{
+    std::lock_guard l(m_mutex);
+    return m_entries.size();
+}
+
+void NegativeCache::load() noexcept
+{
+    auto fd = ::open(m_bloomPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    BloomHeader h = {};
+    std::vector<uint8_t> bits(BloomBits / 8);
+
+    bool ok = (::read(fd, &h, sizeof(h)) == ssize_t(sizeof(h))) &&
+              (h.magic == BloomMagic) &&
+              (h.bits == BloomBits) &&
+              (h.hashes == BloomHashes) &&
+              (::read(fd, bits.data(), bits.size()) == ssize_t(bits.size()));
+
+    ::close(fd);
+
+    if (!ok)
+    {
+        Er::Log::Warning(m_log) << "Ignoring malformed [" << m_bloomPath << "]";
+        return;
+    }
+
+    // everything in it has expired by now
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - h.savedAt;
+    if ((age < 0) || (age >= m_ttl.count()))
+        return;
+
+    m_loaded.swap(bits);
+
+    Er::Log::Info(m_log) << "Loaded negative result filter from [" << m_bloomPath << "]";
+}
+
+void NegativeCache::save() noexcept
+{
+    try
+    {
+        // only what's still unexpired goes into the filter
+        std::vector<uint8_t> bits(BloomBits / 8, 0);
+        std::size_t count = 0;
+
+        {
+            std::lock_guard l(m_mutex);
+
+            auto now = Clock::now();
+            for (auto& [key, expires] : m_entries)
+            {
+                if (expires <= now)
+                    continue;
+
+                auto separator = key.find('\0');
+                uint32_t positions[BloomHashes];
+                bloomPositions(std::string_view(key.data(), separator), unsigned(std::stoul(key.substr(separator + 1))), positions);
+
+                for (auto bit : positions)
+                    bits[bit / 8] |= uint8_t(1U << (bit % 8));
+
+                ++count;
+            }
+        }
+
+        BloomHeader h = { BloomMagic, BloomBits, BloomHashes, 0, std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+
+        auto tmpPath = m_bloomPath + ".tmp";
+        auto fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0)
+        {
+            auto e = errno;
+            Er::Log::Error(m_log) << "Failed to create [" << tmpPath << "]: " << e << " " << Er::Util::posixErrorToString(e);
+            return;
+        }
+
+        bool ok = (::write(fd, &h, sizeof(h)) == ssize_t(sizeof(h))) &&
+                  (::write(fd, bits.data(), bits.size()) == ssize_t(bits.size()));
+
+        ::close(fd);
+
+        if (!ok || (::rename(tmpPath.c_str(), m_bloomPath.c_str()) != 0))
+        {
+            auto e = errno;
+            Er::Log::Error(m_log) << "Failed to save [" << m_bloomPath << "]: " << e << " " << Er::Util::posixErrorToString(e);
+            ::unlink(tmpPath.c_str());
+            return;
+        }
+
+        Er::Log::Debug(m_log) << "Saved " << count << " negative results to [" << m_bloomPath << "]";
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// remembers icons that could not be found, for a while
+//
+// Entries live in memory and expire after the TTL. On shutdown the unexpired
+// ones are saved as a Bloom filter, so after a restart the names that were
+// missing a moment ago are 'suspected' missing without a theme lookup.
+//
+
+class NegativeCache final
+    : public Er::NonCopyable
+{
+public:
+    enum class Result
+    {
+        Unknown,
+        Missing,
+        Suspected // the Bloom filter from the previous run says it was missing
+    };
+
+    struct Key
+    {
+        std::string name;
+        unsigned size;
+    };
+
+    ~NegativeCache();
+    explicit NegativeCache(Er::Log::ILog* log, std::string_view cacheDir, std::chrono::seconds ttl);
+
+    Result check(std::string_view name, unsigned size);
+    void add(std::string_view name, unsigned size);
+    void remove(std::string_view name, unsigned size);
+
+    // forgets everything including the previous run's Bloom filter
+    void clear();
+
+    // removes and returns expired entries so they can be looked up again
+    std::vector<Key> takeExpired();
+
+    std::size_t size() const;
+    void save() noexcept;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t BloomMagic = 0x46425245; // 'ERBF'
+    static constexpr uint32_t BloomBits = 1U << 20;
+    static constexpr uint32_t BloomHashes = 7;
+
+    struct BloomHeader
+    {
+        uint32_t magic;
+        uint32_t bits;
+        uint32_t hashes;
+        uint32_t reserved;
+        int64_t savedAt; // seconds since the epoch
+    };
+
+    static std::string makeKey(std::string_view name, unsigned size);
+    static void bloomPositions(std::string_view name, unsigned size, uint32_t (&positions)[BloomHashes]) noexcept;
+    void load() noexcept;
+
+    Er::Log::ILog* const m_log;
+    const std::string m_bloomPath;
+    const std::chrono::seconds m_ttl;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Clock::time_point> m_entries; // key -> expiration time
+    std::vector<uint8_t> m_loaded; // Bloom filter saved by the previous run; empty if none
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,1208 @@
+#include "packstore.hpp"
+
+#include <erebus/exception.hxx>
+#include <erebus/util/format.hxx>
+#include <erebus/util/posixerror.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace Pack
+{
+
+uint64_t hashKey(std::string_view name, unsigned size) noexcept
+{
+    // FNV-1a; must stay stable across builds since it's persisted
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (auto c : name)
+    {
+        h ^= uint8_t(c);
+        h *= 0x100000001b3ULL;
+    }
+
+    for (unsigned i = 0; i < sizeof(uint32_t); ++i)
+    {
+        h ^= uint8_t(size >> (i * 8));
+        h *= 0x100000001b3ULL;
+    }
+
+    return h ? h : 1; // 0 is reserved for empty buckets
+}
+
+std::string makeReference(std::string_view packPath, uint64_t recordOffset, uint32_t dataLength)
+{
+    return Er::Util::format("%.*s@%llu:%u", int(packPath.size()), packPath.data(), static_cast<unsigned long long>(recordOffset), dataLength);
+}
+
+std::optional<Reference> parseReference(std::string_view ref)
+{
+    auto at = ref.rfind('@');
+    if (at == std::string_view::npos)
+        return std::nullopt;
+
+    auto colon = ref.find(':', at);
+    if (colon == std::string_view::npos)
+        return std::nullopt;
+
+    Reference r;
+    r.packPath = std::string(ref.substr(0, at));
+
+    try
+    {
+        r.offset = std::stoull(std::string(ref.substr(at + 1, colon - at - 1)));
+        r.length = uint32_t(std::stoul(std::string(ref.substr(colon + 1))));
+    }
+    catch (std::exception&)
+    {
+        return std::nullopt;
+    }
+
+    return r;
+}
+
+} // namespace Pack {}
+
+
+namespace
+{
+
+std::string makePath(std::string_view dir, std::string_view name)
+{
+    return (std::filesystem::path(dir) / name).string();
+}
+
+bool readAll(int fd, void* buffer, std::size_t size, uint64_t offset) noexcept
+{
+    auto p = static_cast<char*>(buffer);
+    while (size > 0)
+    {
+        auto r = ::pread(fd, p, size, off_t(offset));
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if (r == 0)
+            return false; // EOF
+
+        p += r;
+        size -= std::size_t(r);
+        offset += uint64_t(r);
+    }
+
+    return true;
+}
+
+bool writeAll(int fd, const void* buffer, std::size_t size, uint64_t offset) noexcept
+{
+    auto p = static_cast<const char*>(buffer);
+    while (size > 0)
+    {
+        auto r = ::pwrite(fd, p, size, off_t(offset));
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        p += r;
+        size -= std::size_t(r);
+        offset += uint64_t(r);
+    }
+
+    return true;
+}
+
+std::string lastError()
+{
+    auto e = errno;
+    return Er::Util::format("%d %s", e, Er::Util::posixErrorToString(e).c_str());
+}
+
+
+struct PackEntry
+{
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t keyLength;
+    uint32_t dataLength;
+
+    uint64_t dataOffset() const noexcept
+    {
+        return offset + sizeof(Pack::RecordHeader) + keyLength;
+    }
+
+    uint64_t recordLength() const noexcept
+    {
+        return sizeof(Pack::RecordHeader) + keyLength + dataLength;
+    }
+};
+
+// (name, size) -> latest record
+using PackEntries = std::unordered_map<std::string, PackEntry>;
+
+std::string makeEntryKey(std::string_view name, unsigned size)
+{
+    std::string key(name);
+    key.push_back('\0');
+    key.append(std::to_string(size));
+    return key;
+}
+
+std::string_view entryName(const std::string& key) noexcept
+{
+    return std::string_view(key.data(), key.find('\0'));
+}
+
+
+// reads all valid records; returns the offset past the last one
+uint64_t scanPack(int fd, uint64_t fileSize, PackEntries& entries)
+{
+    uint64_t offset = 0;
+    std::string name;
+
+    while (offset + sizeof(Pack::RecordHeader) <= fileSize)
+    {
+        Pack::RecordHeader h = {};
+        if (!readAll(fd, &h, sizeof(h), offset))
+            break;
+
+        if (h.magic != Pack::RecordMagic)
+            break;
+
+        auto end = offset + sizeof(h) + h.keyLength + h.dataLength;
+        if (end > fileSize)
+            break; // torn write at the tail
+
+        name.resize(h.keyLength);
+        if (h.keyLength && !readAll(fd, name.data(), h.keyLength, offset + sizeof(h)))
+            break;
+
+        if (h.flags & Pack::Removed)
+            entries.erase(makeEntryKey(name, h.size));
+        else
+            entries[makeEntryKey(name, h.size)] = PackEntry{ offset, h.size, h.flags, h.keyLength, h.dataLength };
+
+        offset = end;
+    }
+
+    return offset;
+}
+
+// the hash table part of the index
+std::vector<Pack::IndexEntry> buildIndex(const PackEntries& entries)
+{
+    uint32_t bucketCount = 16;
+    while (bucketCount < entries.size() * 2)
+        bucketCount <<= 1;
+
+    std::vector<Pack::IndexEntry> table(bucketCount, Pack::IndexEntry{});
+    for (auto& [key, e] : entries)
+    {
+        auto hash = Pack::hashKey(entryName(key), e.size);
+        auto i = hash & (bucketCount - 1);
+        while (table[i].hash)
+            i = (i + 1) & (bucketCount - 1);
+
+        table[i] = Pack::IndexEntry{ hash, e.offset, e.size, e.flags, e.keyLength, e.dataLength };
+    }
+
+    return table;
+}
+
+bool writeIndex(Er::Log::ILog* log, const std::string& indexPath, const std::vector<Pack::IndexEntry>& table, uint32_t entryCount, uint64_t packSize) noexcept
+{
+    try
+    {
+        Pack::IndexHeader header = { Pack::IndexMagic, Pack::IndexVersion, packSize, uint32_t(table.size()), entryCount };
+
+        auto tmpPath = indexPath + ".tmp";
+        auto fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0)
+        {
+            Er::Log::Error(log) << "Failed to create [" << tmpPath << "]: " << lastError();
+            return false;
+        }
+
+        bool ok = writeAll(fd, &header, sizeof(header), 0) &&
+                  writeAll(fd, table.data(), table.size() * sizeof(Pack::IndexEntry), sizeof(header)) &&
+                  (::fsync(fd) == 0);
+
+        if (!ok)
+            Er::Log::Error(log) << "Failed to write [" << tmpPath << "]: " << lastError();
+
+        ::close(fd);
+
+        // readers see either the old index or the new one, never a partial one
+        if (ok && (::rename(tmpPath.c_str(), indexPath.c_str()) != 0))
+        {
+            Er::Log::Error(log) << "Failed to publish [" << indexPath << "]: " << lastError();
+            ok = false;
+        }
+
+        if (!ok)
+            ::unlink(tmpPath.c_str());
+
+        return ok;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(log) << "Unexpected exception: " << e.what();
+    }
+
+    return false;
+}
+
+// writes the records 'order' points to back to back, in that order, into an empty 'out'
+bool copyRecords(Er::Log::ILog* log, int in, int out, const std::vector<PackEntries::const_iterator>& order, PackEntries& copied, uint64_t& copiedSize) noexcept
+{
+    try
+    {
+        std::vector<char> buffer;
+        copiedSize = 0;
+
+        for (auto& it : order)
+        {
+            auto& e = it->second;
+            auto length = e.recordLength();
+            buffer.resize(length);
+
+            if (!readAll(in, buffer.data(), length, e.offset) || !writeAll(out, buffer.data(), length, copiedSize))
+            {
+                Er::Log::Error(log) << "Failed to copy a record: " << lastError();
+                return false;
+            }
+
+            auto moved = e;
+            moved.offset = copiedSize;
+            copied.insert({ it->first, moved });
+            copiedSize += length;
+        }
+
+        return true;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(log) << "Unexpected exception: " << e.what();
+    }
+
+    return false;
+}
+
+// copies the bytes [from, to) of 'in' to 'out' at 'at'
+bool copyRange(Er::Log::ILog* log, int in, int out, uint64_t from, uint64_t to, uint64_t at) noexcept
+{
+    try
+    {
+        constexpr uint64_t ChunkSize = 1024 * 1024;
+        std::vector<char> buffer(std::min(ChunkSize, to - from));
+
+        while (from < to)
+        {
+            auto length = std::min(ChunkSize, to - from);
+            if (!readAll(in, buffer.data(), length, from) || !writeAll(out, buffer.data(), length, at))
+            {
+                Er::Log::Error(log) << "Failed to copy records: " << lastError();
+                return false;
+            }
+
+            from += length;
+            at += length;
+        }
+
+        return true;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(log) << "Unexpected exception: " << e.what();
+    }
+
+    return false;
+}
+
+
+class PackStore final
+    : public IIconStore
+    , public Er::NonCopyable
+{
+public:
+    ~PackStore()
+    {
+        flush();
+        ::close(m_fd);
+    }
+
+    explicit PackStore(Er::Log::ILog* log, std::string_view cacheDir)
+        : m_log(log)
+        , m_packPath(makePath(cacheDir, Pack::PackFileName))
+        , m_indexPath(makePath(cacheDir, Pack::IndexFileName))
+    {
+        open();
+
+        Er::Log::Info(m_log) << "Opened icon pack [" << m_packPath << "] with " << m_entries.size() << " entries, " << m_packSize.load(std::memory_order_relaxed) << " bytes";
+
+        // consumers may still hold references from the previous run; they verify them
+        if (!maybeCompact())
+            publish();
+    }
+
+    std::optional<IconInfo> find(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto key = makeEntryKey(name, size);
+
+            std::shared_lock l(m_mutex);
+
+            auto it = m_entries.find(key);
+            if (it == m_entries.end())
+                return std::nullopt;
+
+            if (it->second.flags & Pack::Missing)
+                return IconInfo(IconInfo::Type::Invalid);
+
+            m_lastUsed.find(key)->second.store(++m_useClock, std::memory_order_relaxed);
+
+            return IconInfo(IconInfo::Type::Valid, Pack::makeReference(m_packPath, it->second.offset, it->second.dataLength));
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return std::nullopt;
+    }
+
+    IconInfo put(std::string_view name, unsigned size, std::string_view data) noexcept override
+    {
+        auto entry = append(name, size, 0, data);
+        if (!entry)
+            return IconInfo(IconInfo::Type::Invalid);
+
+        return IconInfo(IconInfo::Type::Valid, Pack::makeReference(m_packPath, entry->offset, entry->dataLength));
+    }
+
+    std::optional<std::string> read(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto key = makeEntryKey(name, size);
+
+            std::shared_lock l(m_mutex);
+
+            auto it = m_entries.find(key);
+            if ((it == m_entries.end()) || (it->second.flags & Pack::Missing))
+                return std::nullopt;
+
+            std::string data(it->second.dataLength, '\0');
+            if (!readAll(m_fd, data.data(), data.size(), it->second.dataOffset()))
+            {
+                Er::Log::Error(m_log) << "Failed to read [" << name << "] from [" << m_packPath << "]: " << lastError();
+                return std::nullopt;
+            }
+
+            return data;
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return std::nullopt;
+    }
+
+    void touch(std::string_view name, unsigned size) noexcept override
+    {
+        try
+        {
+            auto key = makeEntryKey(name, size);
+
+            std::shared_lock l(m_mutex);
+
+            auto it = m_lastUsed.find(key);
+            if (it != m_lastUsed.end())
+                it->second.store(++m_useClock, std::memory_order_relaxed);
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+    }
+
+    uint64_t diskUsage() const noexcept override
+    {
+        // tombstones and superseded records take space too until compacted
+        return m_packSize.load(std::memory_order_relaxed);
+    }
+
+    uint64_t generation() const noexcept override
+    {
+        return m_generation.load(std::memory_order_relaxed);
+    }
+
+    std::vector<Key> evict(uint64_t budget) noexcept override
+    {
+        std::vector<Key> evicted;
+
+        try
+        {
+            std::lock_guard maintenance(m_maintenanceMutex);
+            std::unique_lock l(m_mutex);
+
+            if (m_packSize.load(std::memory_order_relaxed) <= budget)
+                return evicted;
+
+            // records appended earlier were used earlier unless touched since
+            struct Candidate
+            {
+                uint64_t lastUsed;
+                uint64_t offset;
+                const std::string* key;
+            };
+
+            std::vector<Candidate> candidates;
+            candidates.reserve(m_entries.size());
+            for (auto& [key, e] : m_entries)
+                candidates.push_back(Candidate{ m_lastUsed[key].load(std::memory_order_relaxed), e.offset, &key });
+
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return (a.lastUsed < b.lastUsed) || ((a.lastUsed == b.lastUsed) && (a.offset < b.offset)); });
+
+            std::vector<std::string> keys;
+            auto remaining = m_liveBytes.load(std::memory_order_relaxed);
+            for (auto& c : candidates)
+            {
+                if (remaining <= budget)
+                    break;
+
+                remaining -= m_entries[*c.key].recordLength();
+                keys.push_back(*c.key);
+            }
+
+            if (!remove(keys))
+                return evicted;
+
+            for (auto& key : keys)
+                evicted.push_back(Key{ std::string(entryName(key)), unsigned(std::stoul(key.substr(key.find('\0') + 1))) });
+
+            if (!evicted.empty())
+                Er::Log::Info(m_log) << "Evicted " << evicted.size() << " icons from [" << m_packPath << "], " << m_liveBytes.load(std::memory_order_relaxed) << " bytes left";
+
+            l.unlock();
+
+            // the tombstones have only made the file larger
+            if ((m_packSize.load(std::memory_order_relaxed) <= budget) || !compact())
+                publish();
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return evicted;
+    }
+
+    std::vector<Key> removeIf(const std::function<bool(std::string_view name)>& stale) noexcept override
+    {
+        std::vector<Key> removed;
+
+        try
+        {
+            std::lock_guard maintenance(m_maintenanceMutex);
+            std::vector<std::string> keys;
+
+            {
+                std::shared_lock l(m_mutex);
+
+                keys.reserve(m_entries.size());
+                for (auto& [key, e] : m_entries)
+                    keys.push_back(key);
+            }
+
+            std::erase_if(keys, [&stale](const std::string& key) { return !stale(entryName(key)); });
+            if (keys.empty())
+                return removed;
+
+            std::unique_lock l(m_mutex);
+
+            // may have been evicted in the meantime
+            std::erase_if(keys, [this](const std::string& key) { return !m_entries.contains(key); });
+
+            if (!remove(keys))
+                return removed;
+
+            for (auto& key : keys)
+                removed.push_back(Key{ std::string(entryName(key)), unsigned(std::stoul(key.substr(key.find('\0') + 1))) });
+
+            l.unlock();
+
+            if (!maybeCompact())
+                publish();
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return removed;
+    }
+
+    void flush() noexcept override
+    {
+        std::lock_guard maintenance(m_maintenanceMutex);
+
+        if (m_unpublished.load(std::memory_order_relaxed))
+            publish();
+    }
+
+private:
+    static constexpr uint64_t CompactMinSize = 4 * 1024 * 1024; // don't bother compacting smaller packs
+
+    void open()
+    {
+        m_fd = ::open(m_packPath.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (m_fd < 0)
+            ErThrow(Er::Util::format("Failed to open %s: %s", m_packPath.c_str(), lastError().c_str()));
+
+        struct stat st = {};
+        if (::fstat(m_fd, &st) != 0)
+        {
+            auto error = lastError();
+            ::close(m_fd);
+            ErThrow(Er::Util::format("Failed to stat %s: %s", m_packPath.c_str(), error.c_str()));
+        }
+
+        // the pack itself is the source of truth; the index is only for readers
+        m_entries.clear();
+        auto packSize = scanPack(m_fd, uint64_t(st.st_size), m_entries);
+        m_packSize.store(packSize, std::memory_order_relaxed);
+        if (packSize < uint64_t(st.st_size))
+        {
+            Er::Log::Warning(m_log) << "Discarding " << (uint64_t(st.st_size) - packSize) << " bytes of incomplete records in [" << m_packPath << "]";
+            if (::ftruncate(m_fd, off_t(packSize)) != 0)
+                Er::Log::Error(m_log) << "Failed to truncate [" << m_packPath << "]: " << lastError();
+        }
+
+        uint64_t live = 0;
+        m_lastUsed.clear();
+        for (auto& [key, e] : m_entries)
+        {
+            live += e.recordLength();
+            m_lastUsed.try_emplace(key, 0);
+        }
+
+        m_liveBytes.store(live, std::memory_order_relaxed);
+    }
+
+    // appends tombstones for 'keys' and drops them from the index;
+    // m_mutex is held exclusively by the caller
+    bool remove(const std::vector<std::string>& keys) noexcept
+    {
+        try
+        {
+            if (keys.empty())
+                return true;
+
+            std::string records;
+            for (auto& key : keys)
+            {
+                auto& e = m_entries.at(key);
+                auto name = entryName(key);
+
+                Pack::RecordHeader h = { Pack::RecordMagic, Pack::Removed, e.size, uint32_t(name.size()), 0, 0 };
+                records.append(reinterpret_cast<const char*>(&h), sizeof(h));
+                records.append(name);
+            }
+
+            auto packSize = m_packSize.load(std::memory_order_relaxed);
+            if (!writeAll(m_fd, records.data(), records.size(), packSize))
+            {
+                Er::Log::Error(m_log) << "Failed to append to [" << m_packPath << "]: " << lastError();
+
+                if (::ftruncate(m_fd, off_t(packSize)) != 0)
+                    Er::Log::Error(m_log) << "Failed to truncate [" << m_packPath << "]: " << lastError();
+
+                return false;
+            }
+
+            m_packSize.store(packSize + records.size(), std::memory_order_relaxed);
+
+            // references already handed out stay valid: the data is still in the pack
+            for (auto& key : keys)
+            {
+                auto it = m_entries.find(key);
+                m_liveBytes.fetch_sub(it->second.recordLength(), std::memory_order_relaxed);
+                m_entries.erase(it);
+                m_lastUsed.erase(key);
+            }
+
+            m_unpublished.fetch_add(unsigned(keys.size()), std::memory_order_relaxed);
+            return true;
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return false;
+    }
+
+    std::optional<PackEntry> append(std::string_view name, unsigned size, uint32_t flags, std::string_view data) noexcept
+    {
+        try
+        {
+            Pack::RecordHeader h = { Pack::RecordMagic, flags, size, uint32_t(name.size()), uint32_t(data.size()), 0 };
+
+            std::string record;
+            record.reserve(sizeof(h) + name.size() + data.size());
+            record.append(reinterpret_cast<const char*>(&h), sizeof(h));
+            record.append(name);
+            record.append(data);
+
+            auto key = makeEntryKey(name, size);
+
+            std::unique_lock l(m_mutex);
+
+            auto packSize = m_packSize.load(std::memory_order_relaxed);
+            if (!writeAll(m_fd, record.data(), record.size(), packSize))
+            {
+                Er::Log::Error(m_log) << "Failed to append to [" << m_packPath << "]: " << lastError();
+
+                // don't leave a torn record behind
+                if (::ftruncate(m_fd, off_t(packSize)) != 0)
+                    Er::Log::Error(m_log) << "Failed to truncate [" << m_packPath << "]: " << lastError();
+
+                return std::nullopt;
+            }
+
+            PackEntry entry{ packSize, size, flags, h.keyLength, h.dataLength };
+            auto previous = m_entries.find(key);
+            if (previous != m_entries.end())
+                m_liveBytes.fetch_sub(previous->second.recordLength(), std::memory_order_relaxed);
+            m_liveBytes.fetch_add(entry.recordLength(), std::memory_order_relaxed);
+            m_entries[key] = entry;
+            m_lastUsed[key].store(++m_useClock, std::memory_order_relaxed);
+            m_packSize.store(packSize + record.size(), std::memory_order_relaxed);
+
+            // the index is written by flush() off the serving path
+            m_unpublished.fetch_add(1, std::memory_order_relaxed);
+
+            return entry;
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        return std::nullopt;
+    }
+
+    // m_maintenanceMutex is held by the caller (or we're in the constructor)
+    void publish() noexcept
+    {
+        try
+        {
+            std::vector<Pack::IndexEntry> table;
+            uint32_t entryCount = 0;
+            uint64_t packSize = 0;
+            unsigned unpublished = 0;
+
+            {
+                std::shared_lock l(m_mutex);
+
+                table = buildIndex(m_entries);
+                entryCount = uint32_t(m_entries.size());
+                packSize = m_packSize.load(std::memory_order_relaxed);
+                unpublished = m_unpublished.load(std::memory_order_relaxed);
+            }
+
+            // records must be durable before an index pointing at them is;
+            // m_fd only changes under m_maintenanceMutex
+            if (::fdatasync(m_fd) != 0)
+                Er::Log::Warning(m_log) << "Failed to sync [" << m_packPath << "]: " << lastError();
+
+            if (writeIndex(m_log, m_indexPath, table, entryCount, packSize))
+                m_unpublished.fetch_sub(unpublished, std::memory_order_relaxed);
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+    }
+
+    // m_maintenanceMutex is held by the caller (or we're in the constructor)
+    bool maybeCompact() noexcept
+    {
+        auto packSize = m_packSize.load(std::memory_order_relaxed);
+        if ((packSize < CompactMinSize) || (packSize <= 2 * m_liveBytes.load(std::memory_order_relaxed)))
+            return false;
+
+        return compact();
+    }
+
+    // rewrites the pack with only the live records, least recently used first, so that
+    // the order survives a restart; references handed out before stop verifying and
+    // readers re-map the pack as its inode changes
+    // the bulk of the copy runs unlocked: removal and compaction are serialized by
+    // m_maintenanceMutex, so records in the snapshot stay where they are while put()
+    // keeps appending; only what was appended meanwhile is copied under the lock
+    // m_maintenanceMutex is held by the caller (or we're in the constructor)
+    bool compact() noexcept
+    {
+        auto tmpPath = m_packPath + ".tmp";
+        int out = -1;
+
+        try
+        {
+            PackEntries snapshot;
+            std::unordered_map<std::string, uint64_t> lastUsed;
+            uint64_t from = 0;
+
+            {
+                std::shared_lock l(m_mutex);
+
+                snapshot = m_entries;
+                lastUsed.reserve(m_lastUsed.size());
+                for (auto& [key, used] : m_lastUsed)
+                    lastUsed.emplace(key, used.load(std::memory_order_relaxed));
+
+                from = m_packSize.load(std::memory_order_relaxed);
+            }
+
+            std::vector<PackEntries::const_iterator> order;
+            order.reserve(snapshot.size());
+            for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it)
+                order.push_back(it);
+
+            std::sort(
+                order.begin(),
+                order.end(),
+                [&lastUsed](PackEntries::const_iterator a, PackEntries::const_iterator b)
+                {
+                    auto lastA = lastUsed[a->first];
+                    auto lastB = lastUsed[b->first];
+                    return (lastA < lastB) || ((lastA == lastB) && (a->second.offset < b->second.offset));
+                });
+
+            out = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            if (out < 0)
+            {
+                Er::Log::Error(m_log) << "Failed to create [" << tmpPath << "]: " << lastError();
+                return false;
+            }
+
+            PackEntries compacted;
+            uint64_t compactedSize = 0;
+            bool ok = copyRecords(m_log, m_fd, out, order, compacted, compactedSize);
+
+            // catch up with most of what was appended meanwhile before locking
+            uint64_t caught = from;
+            if (ok)
+            {
+                {
+                    std::shared_lock l(m_mutex);
+                    caught = m_packSize.load(std::memory_order_relaxed);
+                }
+
+                ok = copyRange(m_log, m_fd, out, from, caught, compactedSize);
+            }
+
+            if (ok && (::fsync(out) != 0))
+            {
+                Er::Log::Error(m_log) << "Failed to sync [" << tmpPath << "]: " << lastError();
+                ok = false;
+            }
+
+            if (!ok)
+            {
+                ::close(out);
+                ::unlink(tmpPath.c_str());
+                return false;
+            }
+
+            uint64_t packSize = 0;
+
+            {
+                std::unique_lock l(m_mutex);
+
+                packSize = m_packSize.load(std::memory_order_relaxed);
+                ok = copyRange(m_log, m_fd, out, caught, packSize, compactedSize + (caught - from));
+
+                if (ok && (packSize > caught) && (::fdatasync(out) != 0))
+                {
+                    Er::Log::Error(m_log) << "Failed to sync [" << tmpPath << "]: " << lastError();
+                    ok = false;
+                }
+
+                if (ok && (::rename(tmpPath.c_str(), m_packPath.c_str()) != 0))
+                {
+                    Er::Log::Error(m_log) << "Failed to replace [" << m_packPath << "]: " << lastError();
+                    ok = false;
+                }
+
+                if (!ok)
+                {
+                    ::close(out);
+                    ::unlink(tmpPath.c_str());
+                    return false;
+                }
+
+                // entries either still point into the snapshot or to the appended tail
+                uint64_t live = 0;
+                for (auto& [key, e] : m_entries)
+                {
+                    if (e.offset >= from)
+                        e.offset = compactedSize + (e.offset - from);
+                    else
+                        e.offset = compacted.at(key).offset;
+
+                    live += e.recordLength();
+                }
+
+                ::close(m_fd);
+                m_fd = out;
+                m_packSize.store(compactedSize + (packSize - from), std::memory_order_relaxed);
+                m_liveBytes.store(live, std::memory_order_relaxed);
+                m_generation.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            out = -1;
+            publish();
+
+            Er::Log::Info(m_log) << "Compacted [" << m_packPath << "] from " << packSize << " to " << m_packSize.load(std::memory_order_relaxed) << " bytes, " << compacted.size() << " entries";
+            return true;
+        }
+        catch (std::exception& e)
+        {
+            Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+        }
+
+        if (out >= 0)
+        {
+            ::close(out);
+            ::unlink(tmpPath.c_str());
+        }
+
+        return false;
+    }
+
+    Er::Log::ILog* m_log;
+    std::string m_packPath;
+    std::string m_indexPath;
+    int m_fd = -1;
+    std::mutex m_maintenanceMutex; // serializes removal, compaction and publishing; only they change m_fd
+    std::shared_mutex m_mutex;
+    PackEntries m_entries;
+    std::unordered_map<std::string, std::atomic<uint64_t>> m_lastUsed; // same keys as m_entries
+    std::atomic<uint64_t> m_useClock = 0; // ticks on every use; survives restarts only as the record order
+    std::atomic<uint64_t> m_liveBytes = 0; // records m_entries refer to
+    std::atomic<uint64_t> m_packSize = 0; // the whole file; written with m_mutex held exclusively
+    std::atomic<uint64_t> m_generation = 0; // bumped by compaction
+    std::atomic<unsigned> m_unpublished = 0; // records the index doesn't know about yet
+};
+
+} // namespace {}
+
+
+PackReader::~PackReader()
+{
+    unmap();
+}
+
+PackReader::PackReader(std::string_view cacheDir)
+    : m_packPath(makePath(cacheDir, Pack::PackFileName))
+    , m_indexPath(makePath(cacheDir, Pack::IndexFileName))
+{
+    refresh();
+}
+
+void PackReader::unmap() noexcept
+{
+    if (m_index)
+        ::munmap(const_cast<char*>(m_index), m_indexSize);
+
+    m_index = nullptr;
+    m_indexSize = 0;
+    m_indexIno = 0;
+
+    unmapPack();
+}
+
+void PackReader::unmapPack() noexcept
+{
+    if (m_pack)
+        ::munmap(const_cast<char*>(m_pack), m_packSize);
+
+    m_pack = nullptr;
+    m_packSize = 0;
+    m_packIno = 0;
+}
+
+bool PackReader::mapPack(std::size_t required) noexcept
+{
+    // compaction replaces the pack with rename(), so the mapping we have may be of a file that's gone
+    struct stat st = {};
+    if (::stat(m_packPath.c_str(), &st) != 0)
+    {
+        unmapPack();
+        return false;
+    }
+
+    if (m_pack && (st.st_ino == m_packIno) && (m_packSize >= required))
+        return true;
+
+    auto fd = ::open(m_packPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if ((::fstat(fd, &st) != 0) || (std::size_t(st.st_size) < required) || (st.st_size == 0))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    auto p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    unmapPack();
+
+    m_pack = static_cast<const char*>(p);
+    m_packSize = std::size_t(st.st_size);
+    m_packIno = st.st_ino;
+    return true;
+}
+
+bool PackReader::refresh() noexcept
+{
+    struct stat st = {};
+    if (::stat(m_indexPath.c_str(), &st) != 0)
+        return false;
+
+    if (m_index && (st.st_ino == m_indexIno))
+        return true; // still the same index
+
+    unmap();
+
+    auto fd = ::open(m_indexPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if ((::fstat(fd, &st) != 0) || (std::size_t(st.st_size) < sizeof(Pack::IndexHeader)))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    auto p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    m_index = static_cast<const char*>(p);
+    m_indexSize = std::size_t(st.st_size);
+    m_indexIno = st.st_ino;
+
+    auto header = reinterpret_cast<const Pack::IndexHeader*>(m_index);
+    if ((header->magic != Pack::IndexMagic) ||
+        (header->version != Pack::IndexVersion) ||
+        (header->bucketCount == 0) ||
+        (header->bucketCount & (header->bucketCount - 1)) ||
+        (m_indexSize < sizeof(Pack::IndexHeader) + std::size_t(header->bucketCount) * sizeof(Pack::IndexEntry)))
+    {
+        unmap();
+        return false;
+    }
+
+    // the index never refers past this point
+    if (!mapPack(std::size_t(header->packSize)))
+    {
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<PackReader::Hit> PackReader::lookup(std::string_view name, unsigned size) noexcept
+{
+    if (!m_index)
+        return std::nullopt;
+
+    auto header = reinterpret_cast<const Pack::IndexHeader*>(m_index);
+    auto table = reinterpret_cast<const Pack::IndexEntry*>(m_index + sizeof(Pack::IndexHeader));
+    auto mask = header->bucketCount - 1;
+
+    auto hash = Pack::hashKey(name, size);
+    for (auto i = hash & mask, probes = uint64_t(0); probes <= mask; i = (i + 1) & mask, ++probes)
+    {
+        auto& e = table[i];
+        if (!e.hash)
+            break;
+
+        if ((e.hash != hash) || (e.size != size) || (e.keyLength != name.size()))
+            continue;
+
+        return verify(name, size, e.offset);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<PackReader::Hit> PackReader::verify(std::string_view name, unsigned size, uint64_t offset) noexcept
+{
+    if (offset + sizeof(Pack::RecordHeader) > m_packSize)
+        return std::nullopt;
+
+    auto record = reinterpret_cast<const Pack::RecordHeader*>(m_pack + offset);
+    if ((record->magic != Pack::RecordMagic) || (record->size != size) || (record->keyLength != name.size()) || (record->flags & Pack::Removed))
+        return std::nullopt;
+
+    auto end = offset + sizeof(Pack::RecordHeader) + record->keyLength + record->dataLength;
+    if (end > m_packSize)
+        return std::nullopt;
+
+    auto key = m_pack + offset + sizeof(Pack::RecordHeader);
+    if (std::memcmp(key, name.data(), name.size()))
+        return std::nullopt;
+
+    return Hit{ (record->flags & Pack::Missing) != 0, key + record->keyLength, record->dataLength };
+}
+
+std::optional<PackReader::Hit> PackReader::find(std::string_view name, unsigned size) noexcept
+{
+    auto hit = lookup(name, size);
+    if (!hit && refresh())
+        hit = lookup(name, size);
+
+    return hit;
+}
+
+std::optional<PackReader::Hit> PackReader::resolve(std::string_view name, unsigned size, const Pack::Reference& ref) noexcept
+{
+    if (ref.packPath != m_packPath)
+        return std::nullopt;
+
+    // the record may be newer than the index we've mapped
+    if (!mapPack(std::size_t(ref.offset + sizeof(Pack::RecordHeader) + name.size() + ref.length)))
+        return std::nullopt;
+
+    // the pack may have been compacted since the reference was made
+    auto hit = verify(name, size, ref.offset);
+    if (!hit || hit->missing || (hit->length != ref.length))
+        return std::nullopt;
+
+    return hit;
+}
+
+
+std::unique_ptr<IIconStore> createPackStore(Er::Log::ILog* log, std::string_view cacheDir)
+{
+    return std::make_unique<PackStore>(log, cacheDir);
+}
+
+bool compactPack(Er::Log::ILog* log, std::string_view cacheDir)
+{
+    auto packPath = makePath(cacheDir, Pack::PackFileName);
+    auto indexPath = makePath(cacheDir, Pack::IndexFileName);
+    auto tmpPath = packPath + ".tmp";
+
+    auto in = ::open(packPath.c_str(), O_RDONLY);
+    if (in < 0)
+    {
+        Er::Log::Error(log) << "Failed to open [" << packPath << "]: " << lastError();
+        return false;
+    }
+
+    struct stat st = {};
+    if (::fstat(in, &st) != 0)
+    {
+        Er::Log::Error(log) << "Failed to stat [" << packPath << "]: " << lastError();
+        ::close(in);
+        return false;
+    }
+
+    PackEntries entries;
+    scanPack(in, uint64_t(st.st_size), entries);
+
+    auto out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (out < 0)
+    {
+        Er::Log::Error(log) << "Failed to create [" << tmpPath << "]: " << lastError();
+        ::close(in);
+        return false;
+    }
+
+    // the record order is all that's left of the LRU order after a restart, so keep it
+    std::vector<PackEntries::const_iterator> order;
+    order.reserve(entries.size());
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it)
+        order.push_back(it);
+
+    std::sort(order.begin(), order.end(), [](PackEntries::const_iterator a, PackEntries::const_iterator b) { return a->second.offset < b->second.offset; });
+
+    PackEntries compacted;
+    uint64_t outSize = 0;
+    bool ok = copyRecords(log, in, out, order, compacted, outSize);
+
+    ::close(in);
+
+    if (ok && (::fsync(out) != 0))
+    {
+        Er::Log::Error(log) << "Failed to sync [" << tmpPath << "]: " << lastError();
+        ok = false;
+    }
+
+    ::close(out);
+
+    // readers verify records, so a stale index over the new pack only causes misses
+    if (ok && (::rename(tmpPath.c_str(), packPath.c_str()) != 0))
+    {
+        Er::Log::Error(log) << "Failed to replace [" << packPath << "]: " << lastError();
+        ok = false;
+    }
+
+    if (!ok)
+    {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+
+    if (!writeIndex(log, indexPath, buildIndex(compacted), uint32_t(compacted.size()), outSize))
+        return false;
+
+    Er::Log::Info(log) << "Compacted [" << packPath << "] from " << st.st_size << " to " << outSize << " bytes, " << compacted.size() << " entries";
+    return true;
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "iconstore.hpp"
+
+#include <erebus/erebus.hxx>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <sys/types.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+//
+// Pack store on-disk format
+//
+// icons.pack is append-only: a sequence of records, each being
+//   RecordHeader | key (icon name, keyLength bytes) | data (dataLength bytes)
+// Records with the Missing flag and no data are negative results written
+// by older daemons; they are still understood but no longer written.
+// A later record for the same (name, size) supersedes the earlier one.
+// Records with the Removed flag and no data are tombstones left by eviction;
+// the space they free is reclaimed when the pack is compacted: by the daemon
+// when the pack is over its budget or mostly dead, or offline with --compact.
+// Compaction replaces the pack with rename(), so readers notice it by the inode.
+//
+// icons.idx is an open-addressing hash table over the pack,
+//   IndexHeader | IndexEntry[bucketCount]
+// rebuilt by the writer and published with rename() so readers
+// always see a complete index. Readers must verify the record key
+// since the index may briefly refer to a pack being replaced.
+//
+// The daemon answers Protocol::ResponseMode::Pack requests with a reference
+// '<pack path>@<record offset>:<data length>'; readers verify the record
+// against the name and size they asked for, since the pack may have been
+// replaced (compacted) after the reference was made.
+//
+
+namespace Pack
+{
+
+constexpr uint32_t RecordMagic = 0x4b505245; // 'ERPK'
+constexpr uint32_t IndexMagic = 0x58495245;  // 'ERIX'
+constexpr uint32_t IndexVersion = 1;
+
+constexpr std::string_view PackFileName = "icons.pack";
+constexpr std::string_view IndexFileName = "icons.idx";
+
+enum Flags : uint32_t
+{
+    Missing = 0x0001,
+    Removed = 0x0002
+};
+
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t size;
+    uint32_t keyLength;
+    uint32_t dataLength;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(RecordHeader) == 24);
+
+struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t packSize;    // the index covers records below this offset
+    uint32_t bucketCount; // a power of 2
+    uint32_t entryCount;
+};
+
+static_assert(sizeof(IndexHeader) == 24);
+
+struct IndexEntry
+{
+    uint64_t hash;   // 0 marks an empty bucket
+    uint64_t offset; // of the RecordHeader
+    uint32_t size;
+    uint32_t flags;
+    uint32_t keyLength;
+    uint32_t dataLength;
+};
+
+static_assert(sizeof(IndexEntry) == 32);
+
+
+uint64_t hashKey(std::string_view name, unsigned size) noexcept;
+
+std::string makeReference(std::string_view packPath, uint64_t recordOffset, uint32_t dataLength);
+
+struct Reference
+{
+    std::string packPath;
+    uint64_t offset = 0; // of the RecordHeader
+    uint32_t length = 0; // of the data
+};
+
+std::optional<Reference> parseReference(std::string_view ref);
+
+} // namespace Pack {}
+
+
+//
+// read-only memory-mapped view of a pack store; usable from other processes;
+// not thread-safe
+//
+
+class PackReader final
+    : public Er::NonCopyable
+{
+public:
+    struct Hit
+    {
+        bool missing;
+        const char* data;
+        std::size_t length;
+    };
+
+    ~PackReader();
+    explicit PackReader(std::string_view cacheDir);
+
+    // re-maps the index if the writer has published a new one
+    bool refresh() noexcept;
+
+    std::optional<Hit> find(std::string_view name, unsigned size) noexcept;
+
+    // maps a reference returned by the daemon for (name, size)
+    std::optional<Hit> resolve(std::string_view name, unsigned size, const Pack::Reference& ref) noexcept;
+
+private:
+    void unmap() noexcept;
+    void unmapPack() noexcept;
+    bool mapPack(std::size_t required) noexcept;
+    std::optional<Hit> lookup(std::string_view name, unsigned size) noexcept;
+    std::optional<Hit> verify(std::string_view name, unsigned size, uint64_t offset) noexcept;
+
+    std::string m_packPath;
+    std::string m_indexPath;
+    ino_t m_indexIno = 0;
+    const char* m_index = nullptr;
+    std::size_t m_indexSize = 0;
+    ino_t m_packIno = 0;
+    const char* m_pack = nullptr;
+    std::size_t m_packSize = 0;
+};
+
+
+// rewrites the pack keeping only the latest record for every key and dropping
+// removed ones, in their original order; the daemon must not be running
+bool compactPack(Er::Log::ILog* log, std::string_view cacheDir);
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,246 @@
+#include "prewarm.hpp"
+
+#include <erebus/system/thread.hxx>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+
+#include <boost/algorithm/string.hpp>
+
+#include <QStandardPaths>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace
+{
+
+
+struct Task
+{
+    std::string name;
+    unsigned size;
+};
+
+
+//
+// every worker drains its own deque from the back and steals from
+// the front of the others' when it runs dry; nothing is ever added
+// once the workers are started, so an empty sweep means we're done
+//
+
+class WorkStealingQueues final
+    : public Er::NonCopyable
+{
+public:
+    explicit WorkStealingQueues(std::size_t count)
+        : m_queues(count)
+    {
+    }
+
+    void distribute(std::vector<Task>&& tasks)
+    {
+        std::size_t i = 0;
+        for (auto& t : tasks)
+        {
+            m_queues[i].tasks.push_back(std::move(t));
+            i = (i + 1) % m_queues.size();
+        }
+    }
+
+    std::optional<Task> pop(std::size_t self)
+    {
+        {
+            auto& own = m_queues[self];
+            std::lock_guard l(own.mutex);
+            if (!own.tasks.empty())
+            {
+                auto t = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return t;
+            }
+        }
+
+        for (std::size_t n = 1; n < m_queues.size(); ++n)
+        {
+            auto& victim = m_queues[(self + n) % m_queues.size()];
+            std::lock_guard l(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                auto t = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+                return t;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    std::size_t steals() const noexcept
+    {
+        return m_steals.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Queue> m_queues;
+    std::atomic<std::size_t> m_steals = 0;
+};
+
+
+void collectDesktopIcons(Er::Log::ILog* log, std::set<std::string>& names)
+{
+    std::size_t files = 0;
+    for (auto& location : QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation))
+    {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(location.toStdString(), std::filesystem::directory_options::skip_permission_denied, ec);
+        if (ec)
+            continue;
+
+        for (auto& entry : it)
+        {
+            if (!entry.is_regular_file(ec) || (entry.path().extension() != ".desktop"))
+                continue;
+
+            std::ifstream f(entry.path());
+            std::string line;
+            bool inDesktopEntry = false;
+            while (std::getline(f, line))
+            {
+                boost::trim(line);
+                if (line.starts_with('['))
+                {
+                    inDesktopEntry = (line == "[Desktop Entry]");
+                }
+                else if (inDesktopEntry && line.starts_with("Icon="))
+                {
+                    auto icon = line.substr(5);
+                    boost::trim(icon);
+                    if (!icon.empty())
+                        names.insert(std::move(icon));
+                    break;
+                }
+            }
+
+            ++files;
+        }
+    }
+
+    Er::Log::Info(log) << "Found " << files << " .desktop files";
+}
+
+
+} // namespace {}
+
+
+PrewarmResult prewarm(Er::Log::ILog* log, IconCache& cache, const PrewarmParams& params, std::stop_token stop)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr auto ProgressInterval = std::chrono::seconds(1);
+
+    auto started = Clock::now();
+
+    std::set<std::string> names;
+    collectDesktopIcons(log, names);
+
+    auto themeNames = cache.themeIconNames();
+    Er::Log::Info(log) << "Found " << themeNames.size() << " icons in the theme index";
+    names.insert(themeNames.begin(), themeNames.end());
+
+    std::vector<Task> tasks;
+    tasks.reserve(names.size() * params.sizes.size());
+    for (auto& name : names)
+    {
+        for (auto size : params.sizes)
+            tasks.push_back(Task{ name, size });
+    }
+
+    PrewarmResult result;
+    result.total = tasks.size();
+
+    auto threads = params.threads ? params.threads : std::max(1U, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<std::size_t>(threads, std::max<std::size_t>(tasks.size(), 1)));
+
+    Er::Log::Info(log) << "Prewarming " << result.total << " icons (" << names.size() << " names x " << params.sizes.size() << " sizes) on " << threads << " threads";
+
+    WorkStealingQueues queues(threads);
+    queues.distribute(std::move(tasks));
+
+    std::atomic<std::size_t> done = 0;
+    std::atomic<std::size_t> valid = 0;
+    std::atomic<unsigned> running = threads;
+    std::mutex finishedMutex;
+    std::condition_variable finished;
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            workers.emplace_back(
+                [&, i]()
+                {
+                    Er::System::CurrentThread::setName("iconcache_warm");
+
+                    while (!stop.stop_requested())
+                    {
+                        auto task = queues.pop(i);
+                        if (!task)
+                            break;
+
+                        auto info = cache.cacheIcon(task->name, task->size);
+                        if (info.type == IconInfo::Type::Valid)
+                            valid.fetch_add(1, std::memory_order_relaxed);
+
+                        done.fetch_add(1, std::memory_order_relaxed);
+                    }
+
+                    if (running.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        std::lock_guard l(finishedMutex);
+                        finished.notify_all();
+                    }
+                }
+            );
+        }
+
+        std::unique_lock l(finishedMutex);
+        while (!finished.wait_for(l, ProgressInterval, [&running]() { return running.load(std::memory_order_acquire) == 0; }))
+        {
+            auto n = done.load(std::memory_order_relaxed);
+            Er::Log::Info(log) << "Prewarmed " << n << " of " << result.total << " icons (" << (result.total ? n * 100 / result.total : 100) << "%)";
+        }
+    }
+
+    result.valid = valid.load();
+    result.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+    if (stop.stop_requested())
+        Er::Log::Warning(log) << "Prewarm interrupted after " << done.load() << " of " << result.total << " icons";
+
+    Er::Log::Info(log) << "Prewarmed " << result.valid << " valid icons out of " << result.total << " in " << result.seconds << " s, " << queues.steals() << " tasks stolen";
+
+    return result;
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "iconcache.hpp"
+
+#include <stop_token>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// fills the cache with every icon referenced by installed .desktop files
+// and every icon in the theme index, before any client asks for them
+//
+
+struct PrewarmParams
+{
+    std::vector<unsigned> sizes;
+    unsigned threads = 0; // 0 means std::thread::hardware_concurrency()
+};
+
+struct PrewarmResult
+{
+    std::size_t total = 0;
+    std::size_t valid = 0;
+    double seconds = 0.0;
+};
+
+// must be called from the main thread after 'cache' is constructed
+PrewarmResult prewarm(Er::Log::ILog* log, IconCache& cache, const PrewarmParams& params, std::stop_token stop);
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
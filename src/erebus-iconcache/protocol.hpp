@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+//
+// Response modes on top of Er::Desktop::IIconCacheIpc
+//
+// A consumer picks the mode per request by prefixing the icon name in
+// IconRequest; the response echoes the name as requested. A plain name
+// means Path, so consumers unaware of this keep working unchanged.
+//
+// For prefixed requests the payload of an Ok response is prefixed too,
+// telling how to interpret the rest (the daemon may fall back to another
+// mode, e.g. for icons too large to be sent inline):
+//   '!inline!<encoded icon bytes in base64>'
+//   '!shm!<shm object name>@<offset>:<length>#<generation>' - see ShmArena
+//   '!pack!<pack reference>' - see PackReader
+//   '<file path>'
+//
+// Pack references are only handed to consumers that ask for them; the others
+// get a real file path even when the daemon keeps its icons in a pack.
+//
+// The payload travels in IconResponse::path, a string meant for file paths,
+// so inline icons are base64-encoded (no NULs) and the whole payload is kept
+// within MaxPayload; larger icons fall back to another mode.
+//
+
+namespace Protocol
+{
+
+enum class ResponseMode
+{
+    Path,
+    Inline,
+    Shared,
+    Pack
+};
+
+constexpr std::string_view InlinePrefix = "!inline!";
+constexpr std::string_view SharedPrefix = "!shm!";
+constexpr std::string_view PackPrefix = "!pack!";
+
+constexpr std::size_t MaxPayload = 4096; // PATH_MAX, what IconResponse::path was meant to carry
+
+
+inline std::string makeRequestName(ResponseMode mode, std::string_view name)
+{
+    std::string result;
+
+    if (mode == ResponseMode::Inline)
+        result.append(InlinePrefix);
+    else if (mode == ResponseMode::Shared)
+        result.append(SharedPrefix);
+    else if (mode == ResponseMode::Pack)
+        result.append(PackPrefix);
+
+    result.append(name);
+    return result;
+}
+
+// strips the prefix from a request name or a response payload
+inline ResponseMode parseMode(std::string_view& s) noexcept
+{
+    if (s.starts_with(InlinePrefix))
+    {
+        s.remove_prefix(InlinePrefix.size());
+        return ResponseMode::Inline;
+    }
+
+    if (s.starts_with(SharedPrefix))
+    {
+        s.remove_prefix(SharedPrefix.size());
+        return ResponseMode::Shared;
+    }
+
+    if (s.starts_with(PackPrefix))
+    {
+        s.remove_prefix(PackPrefix.size());
+        return ResponseMode::Pack;
+    }
+
+    return ResponseMode::Path;
+}
+
+inline std::string encodeInline(std::string_view data)
+{
+    static constexpr char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string result;
+    result.reserve((data.size() + 2) / 3 * 4);
+
+    std::size_t i = 0;
+    for (; i + 2 < data.size(); i += 3)
+    {
+        auto v = (uint32_t(uint8_t(data[i])) << 16) | (uint32_t(uint8_t(data[i + 1])) << 8) | uint32_t(uint8_t(data[i + 2]));
+        result.push_back(Alphabet[(v >> 18) & 0x3f]);
+        result.push_back(Alphabet[(v >> 12) & 0x3f]);
+        result.push_back(Alphabet[(v >> 6) & 0x3f]);
+        result.push_back(Alphabet[v & 0x3f]);
+    }
+
+    if (i < data.size())
+    {
+        auto v = uint32_t(uint8_t(data[i])) << 16;
+        if (i + 1 < data.size())
+            v |= uint32_t(uint8_t(data[i + 1])) << 8;
+
+        result.push_back(Alphabet[(v >> 18) & 0x3f]);
+        result.push_back(Alphabet[(v >> 12) & 0x3f]);
+        result.push_back((i + 1 < data.size()) ? Alphabet[(v >> 6) & 0x3f] : '=');
+        result.push_back('=');
+    }
+
+    return result;
+}
+
+// false if 's' is not valid base64
+inline bool decodeInline(std::string_view s, std::string& data)
+{
+    auto value = [](char c) -> int
+    {
+        if ((c >= 'A') && (c <= 'Z')) return c - 'A';
+        if ((c >= 'a') && (c <= 'z')) return c - 'a' + 26;
+        if ((c >= '0') && (c <= '9')) return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    };
+
+    if (s.size() % 4)
+        return false;
+
+    data.clear();
+    data.reserve(s.size() / 4 * 3);
+
+    for (std::size_t i = 0; i < s.size(); i += 4)
+    {
+        auto last = (i + 4 == s.size());
+        auto pad = last ? ((s[i + 3] == '=') + (s[i + 2] == '=')) : 0;
+
+        uint32_t v = 0;
+        for (std::size_t k = 0; k < 4 - pad; ++k)
+        {
+            auto d = value(s[i + k]);
+            if (d < 0)
+                return false;
+
+            v |= uint32_t(d) << (18 - 6 * k);
+        }
+
+        data.push_back(char(v >> 16));
+        if (pad < 2)
+            data.push_back(char((v >> 8) & 0xff));
+        if (pad < 1)
+            data.push_back(char(v & 0xff));
+    }
+
+    return true;
+}
+
+} // namespace Protocol {}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
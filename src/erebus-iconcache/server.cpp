@@ -1,4 +1,5 @@
 #include "server.hpp"
+#include "protocol.hpp"
 
 #include <erebus/system/thread.hxx>
 
@@ -11,25 +12,130 @@ namespace IconCache
 
 IconServer::~IconServer()
 {
-    m_workers.clear();
+    m_scaler.request_stop();
+    if (m_scaler.joinable())
+        m_scaler.join();
+
+    {
+        std::lock_guard l(m_workersMutex);
+
+        // let them all stop at once rather than one timeout after another
+        for (auto& w : m_workers)
+            w->request_stop();
+
+        m_workers.clear();
+    }
+
+    auto served = m_served.load();
+    auto elapsed = std::chrono::duration<double>(Clock::now() - m_started).count();
+    Er::Log::Info(m_log) << "Served " << served << " requests in " << elapsed << " s, average " << (elapsed > 0.0 ? served / elapsed : 0.0) << " req/s, peak " << m_peakRate << " req/s";
 }
 
-IconServer::IconServer(Er::Log::ILog* log, Er::Event* crashEvent, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, IconCache& cache, unsigned workers)
+IconServer::IconServer(Er::Log::ILog* log, Er::Event* crashEvent, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, IconCache& cache, ShmArena* arena, const Params& params)
     : m_log(log)
     , m_crashEvent(crashEvent)
     , m_ipc(ipc)
     , m_cache(cache)
+    , m_arena(arena)
+    , m_params(std::max(params.minWorkers, 1U), std::max({ params.maxWorkers, params.minWorkers, 1U }), std::max(params.batchSize, 1U), params.inlineMax)
 {
-    m_workers.reserve(workers);
-    while (workers--)
     {
-        m_workers.emplace_back(new std::jthread([this](std::stop_token stop) { worker(stop); }));
+        std::lock_guard l(m_workersMutex);
+
+        m_workers.reserve(m_params.maxWorkers);
+        for (unsigned i = 0; i < m_params.minWorkers; ++i)
+            addWorker();
     }
+
+    // also keeps the peak rate when there's nothing to scale
+    m_scaler = std::jthread([this](std::stop_token stop) { scaler(stop); });
+}
+
+void IconServer::addWorker()
+{
+    // m_workersMutex is held by the caller
+    auto id = m_nextWorkerId++;
+    m_workers.emplace_back(new std::jthread([this, id](std::stop_token stop) { worker(stop, id); }));
 }
 
-void IconServer::worker(std::stop_token stop) noexcept
+void IconServer::scaler(std::stop_token stop) noexcept
 {
-    Er::Log::Debug(m_log) << "Icon cache server started";
+    Er::System::CurrentThread::setName("iconcache_scaler");
+
+    unsigned idleIntervals = 0;
+    auto servedPrev = m_served.load();
+    auto timePrev = Clock::now();
+
+    try
+    {
+        while (!stop.stop_requested())
+        {
+            {
+                std::unique_lock l(m_workersMutex);
+                if (m_scalerCv.wait_for(l, stop, ScaleInterval, [&stop]() { return stop.stop_requested(); }))
+                    break;
+            }
+
+            auto served = m_served.load();
+            auto now = Clock::now();
+            auto elapsed = std::chrono::duration<double>(now - timePrev).count();
+            if (elapsed > 0.0)
+                m_peakRate = std::max(m_peakRate, (served - servedPrev) / elapsed);
+
+            servedPrev = served;
+            timePrev = now;
+
+            // a batch that came back full means requests are queueing up
+            auto fullBatches = m_fullBatches.exchange(0);
+            auto busyWakeups = m_busyWakeups.exchange(0);
+
+            std::unique_ptr<std::jthread> retired;
+
+            {
+                std::lock_guard l(m_workersMutex);
+
+                if (fullBatches > 0)
+                {
+                    idleIntervals = 0;
+
+                    if (m_workers.size() < m_params.maxWorkers)
+                    {
+                        addWorker();
+                        Er::Log::Debug(m_log) << "Queue is backing up; scaled up to " << m_workers.size() << " workers";
+                    }
+                }
+                else if (busyWakeups == 0)
+                {
+                    if ((++idleIntervals >= IdleIntervalsBeforeShrink) && (m_workers.size() > m_params.minWorkers))
+                    {
+                        idleIntervals = 0;
+
+                        retired = std::move(m_workers.back());
+                        m_workers.pop_back();
+                        retired->request_stop();
+
+                        Er::Log::Debug(m_log) << "Queue is idle; scaled down to " << m_workers.size() << " workers";
+                    }
+                }
+                else
+                {
+                    idleIntervals = 0;
+                }
+            }
+
+            // joined outside the lock
+            retired.reset();
+        }
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+void IconServer::worker(std::stop_token stop, unsigned id) noexcept
+{
+    Er::Log::Debug(m_log) << "Icon cache server #" << id << " started";
     Er::System::CurrentThread::setName("iconcache_worker");
 
     try
@@ -47,23 +153,157 @@ void IconServer::worker(std::stop_token stop) noexcept
             m_crashEvent->setAndNotifyAll(true);
     }
 
-    Er::Log::Debug(m_log) << "Icon cache server stopped";
+    Er::Log::Debug(m_log) << "Icon cache server #" << id << " stopped";
+}
+
+void IconServer::writeStats(std::ostream& out) const
+{
+    out << "server_received=" << m_received.load(std::memory_order_relaxed) << "\n";
+    out << "server_served=" << m_served.load(std::memory_order_relaxed) << "\n";
+    out << "server_batches=" << m_batches.load(std::memory_order_relaxed) << "\n";
+
+    {
+        std::lock_guard l(m_workersMutex);
+        out << "server_workers=" << m_workers.size() << "\n";
+    }
+
+    m_batchWait.write(out, "server_batch_wait");
+    m_latency.write(out, "server_latency");
+}
+
+std::string IconServer::makePayload(std::string_view requested, unsigned size, const IconInfo& icon) noexcept
+{
+    auto name = requested;
+    auto mode = Protocol::parseMode(name);
+
+    try
+    {
+        if (mode == Protocol::ResponseMode::Path)
+            return m_cache.filePath(name, size, icon);
+
+        if (mode == Protocol::ResponseMode::Pack)
+        {
+            if (!m_cache.packed())
+                return m_cache.filePath(name, size, icon);
+
+            std::string payload(Protocol::PackPrefix);
+            payload.append(icon.path);
+            return payload;
+        }
+
+        auto data = m_cache.iconData(name, size, icon);
+        if (!data)
+            return m_cache.filePath(name, size, icon);
+
+        if ((mode == Protocol::ResponseMode::Shared) && m_arena)
+        {
+            auto ref = m_arena->place(name, size, data);
+            if (ref)
+            {
+                std::string payload(Protocol::SharedPrefix);
+                payload.append(*ref);
+                return payload;
+            }
+        }
+
+        // also the fallback for Shared
+        if (data->size() <= m_params.inlineMax)
+        {
+            std::string payload(Protocol::InlinePrefix);
+            payload.append(Protocol::encodeInline(*data));
+            if (payload.size() <= Protocol::MaxPayload)
+                return payload;
+        }
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+
+    return m_cache.filePath(name, size, icon);
 }
 
 bool IconServer::heartbeat(std::stop_token stop) noexcept
 {
     try
     {
+        std::vector<PulledRequest> batch;
+        std::vector<Clock::time_point> pulled;
+        batch.reserve(m_params.batchSize);
+        pulled.reserve(m_params.batchSize);
+
+        // block for the first request only, then take whatever else is already queued;
+        // a request is gone from the queue once pulled, so every pulled one gets its answer
+        // even if the worker is being stopped
         auto request = m_ipc->pullIconRequest(Timeout);
-        if (request && !stop.stop_requested())
+        while (request)
+        {
+            batch.push_back(std::move(request));
+            pulled.push_back(Clock::now());
+            if ((batch.size() >= m_params.batchSize) || stop.stop_requested())
+                break;
+
+            request = m_ipc->pullIconRequest(std::chrono::milliseconds(0));
+        }
+
+        if (batch.empty())
+            return true;
+
+        m_busyWakeups.fetch_add(1, std::memory_order_relaxed);
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+        m_received.fetch_add(batch.size(), std::memory_order_relaxed);
+        if (batch.size() >= m_params.batchSize)
+            m_fullBatches.fetch_add(1, std::memory_order_relaxed);
+
+        std::vector<Er::Desktop::IIconCacheIpc::IconResponse> responses;
+        responses.reserve(batch.size());
+
+        for (std::size_t i = 0; i < batch.size(); ++i)
         {
-            auto icon = m_cache.cacheIcon(request->name, request->size);
+            auto& request = batch[i];
+            m_batchWait.record(Clock::now() - pulled[i]);
+
+            std::string_view name(request->name);
+            Protocol::parseMode(name);
+
+            IconInfo icon(IconInfo::Type::Invalid);
+            try
+            {
+                icon = m_cache.cacheIcon(name, request->size);
+            }
+            catch (std::exception& e)
+            {
+                // still answered, with NotFound
+                Er::Log::Error(m_log) << "Failed to cache icon " << name << ": " << e.what();
+            }
+
+            std::string payload;
+            if (icon.type != IconCache::IconInfo::Type::Invalid)
+                payload = makePayload(request->name, request->size, icon);
 
-            if (icon.type == IconCache::IconInfo::Type::Invalid)
-                m_ipc->sendIcon(Er::Desktop::IIconCacheIpc::IconResponse(request->name, request->size, Er::Desktop::IIconCacheIpc::IconResponse::Result::NotFound), Timeout);
+            // the response carries the name exactly as requested
+            if (payload.empty())
+                responses.emplace_back(request->name, request->size, Er::Desktop::IIconCacheIpc::IconResponse::Result::NotFound);
             else
-                m_ipc->sendIcon(Er::Desktop::IIconCacheIpc::IconResponse(request->name, request->size, Er::Desktop::IIconCacheIpc::IconResponse::Result::Ok, icon.path), Timeout);
+                responses.emplace_back(request->name, request->size, Er::Desktop::IIconCacheIpc::IconResponse::Result::Ok, std::move(payload));
         }
+
+        for (std::size_t i = 0; i < responses.size(); ++i)
+        {
+            try
+            {
+                m_ipc->sendIcon(responses[i], Timeout);
+            }
+            catch (std::exception& e)
+            {
+                // the rest of the batch is still owed its responses
+                Er::Log::Error(m_log) << "Failed to send icon " << responses[i].name << ": " << e.what();
+            }
+
+            m_latency.record(Clock::now() - pulled[i]);
+        }
+
+        m_served.fetch_add(responses.size(), std::memory_order_relaxed);
     }
     catch (std::exception& e)
     {
@@ -2,11 +2,17 @@
 
 
 #include "iconcache.hpp"
+#include "shmarena.hpp"
+#include "stats.hpp"
 
 #include <erebus/condition.hxx>
 #include <erebus/log.hxx>
 #include <erebus-desktop/ic.hxx>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -22,20 +28,65 @@ class IconServer final
     : public Er::NonCopyable
 {
 public:
+    struct Params
+    {
+        unsigned minWorkers = 1;
+        unsigned maxWorkers = 4;
+        unsigned batchSize = 16; // max requests drained per wakeup
+        std::size_t inlineMax = 3 * 1024; // larger icons are never sent inline; see Protocol::MaxPayload
+
+        constexpr Params() noexcept = default;
+
+        constexpr Params(unsigned minWorkers, unsigned maxWorkers, unsigned batchSize, std::size_t inlineMax) noexcept
+            : minWorkers(minWorkers)
+            , maxWorkers(maxWorkers)
+            , batchSize(batchSize)
+            , inlineMax(inlineMax)
+        {}
+    };
+
     ~IconServer();
-    IconServer(Er::Log::ILog* log, Er::Event* crashEvent, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, IconCache& cache, unsigned workers);
+    // 'arena' may be nullptr, then Shared requests are answered inline or with a path
+    IconServer(Er::Log::ILog* log, Er::Event* crashEvent, std::shared_ptr<Er::Desktop::IIconCacheIpc> ipc, IconCache& cache, ShmArena* arena, const Params& params);
+
+    // key=value lines for StatsReporter
+    void writeStats(std::ostream& out) const;
 
 private:
-    void worker(std::stop_token stop) noexcept;
+    using Clock = std::chrono::steady_clock;
+    using PulledRequest = decltype(std::declval<Er::Desktop::IIconCacheIpc&>().pullIconRequest(std::chrono::milliseconds()));
+
+    void worker(std::stop_token stop, unsigned id) noexcept;
     bool heartbeat(std::stop_token stop) noexcept;
+    void scaler(std::stop_token stop) noexcept;
+    void addWorker();
+    std::string makePayload(std::string_view requested, unsigned size, const IconInfo& icon) noexcept;
 
     static constexpr std::chrono::milliseconds Timeout = std::chrono::milliseconds(1000);
+    static constexpr std::chrono::milliseconds ScaleInterval = std::chrono::milliseconds(1000);
+    static constexpr unsigned IdleIntervalsBeforeShrink = 5;
 
     Er::Log::ILog* m_log;
     Er::Event* m_crashEvent;
     std::shared_ptr<Er::Desktop::IIconCacheIpc> m_ipc;
     IconCache& m_cache;
+    ShmArena* m_arena;
+    const Params m_params;
+    const Clock::time_point m_started = Clock::now();
+    std::atomic<uint64_t> m_received = 0;    // total requests pulled
+    std::atomic<uint64_t> m_served = 0;      // total requests answered
+    std::atomic<uint64_t> m_batches = 0;
+    Histogram m_batchWait;                   // from being pulled to being processed, i.e. behind others in the batch;
+                                             // time spent in the IPC queue before the pull is not visible here
+    Histogram m_latency;                     // from being pulled to the response being sent
+    std::atomic<unsigned> m_fullBatches = 0; // batches that hit batchSize since the last scaler tick
+    std::atomic<unsigned> m_busyWakeups = 0; // wakeups that found any work since the last scaler tick
+    double m_peakRate = 0.0;                 // requests/sec, owned by the scaler
+    mutable std::mutex m_workersMutex;
+    std::condition_variable_any m_scalerCv;
     std::vector<std::unique_ptr<std::jthread>> m_workers;
+    unsigned m_nextWorkerId = 0;
+    std::jthread m_scaler;
 };
 
 
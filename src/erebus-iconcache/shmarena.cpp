@@ -0,0 +1,221 @@
+#include "shmarena.hpp"
+#include "packstore.hpp"
+
+#include <erebus/exception.hxx>
+#include <erebus/util/format.hxx>
+#include <erebus/util/posixerror.hxx>
+
+#include <atomic>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace Shm
+{
+
+std::string makeReference(std::string_view shmName, uint64_t offset, uint32_t length, uint64_t generation)
+{
+    auto ref = Pack::makeReference(shmName, offset, length);
+    ref.push_back('#');
+    ref.append(std::to_string(generation));
+    return ref;
+}
+
+std::optional<Reference> parseReference(std::string_view ref)
+{
+    auto hash = ref.rfind('#');
+    if (hash == std::string_view::npos)
+        return std::nullopt;
+
+    auto location = Pack::parseReference(ref.substr(0, hash));
+    if (!location)
+        return std::nullopt;
+
+    Reference r;
+    r.shmName = std::move(location->packPath);
+    r.offset = location->offset;
+    r.length = location->length;
+
+    try
+    {
+        r.generation = std::stoull(std::string(ref.substr(hash + 1)));
+    }
+    catch (std::exception&)
+    {
+        return std::nullopt;
+    }
+
+    return r;
+}
+
+bool valid(const char* base, std::size_t capacity, const Reference& ref) noexcept
+{
+    if ((ref.offset < sizeof(SlotHeader)) || (ref.offset + ref.length > capacity))
+        return false;
+
+    auto h = reinterpret_cast<const SlotHeader*>(base + ref.offset - sizeof(SlotHeader));
+    auto generation = std::atomic_ref<uint64_t>(const_cast<uint64_t&>(h->generation)).load(std::memory_order_acquire);
+    return (generation == ref.generation) && (h->length == ref.length);
+}
+
+bool validAfterCopy(const char* base, std::size_t capacity, const Reference& ref) noexcept
+{
+    // pairs with the release fence in ShmArena::place(): if the copy saw any of
+    // the new bytes, the generation read below sees the zero written before them
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return valid(base, capacity, ref);
+}
+
+} // namespace Shm {}
+
+
+ShmArena::~ShmArena()
+{
+    if (m_base)
+        ::munmap(m_base, m_capacity);
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    // consumers that have it mapped keep their mappings
+    ::shm_unlink(m_name.c_str());
+}
+
+ShmArena::ShmArena(Er::Log::ILog* log, std::string_view shmName, std::size_t capacity)
+    : m_log(log)
+    , m_name(shmName)
+    , m_capacity(capacity)
+{
+    ErAssert(!m_name.empty() && (m_name.front() == '/'));
+    ErAssert(m_capacity > 0);
+
+    // a stale object left by a crashed daemon may still be mapped by someone; don't reuse it
+    ::shm_unlink(m_name.c_str());
+
+    m_fd = ::shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (m_fd < 0)
+    {
+        auto e = errno;
+        ErThrow(Er::Util::format("Failed to create shared memory %s: %d %s", m_name.c_str(), e, Er::Util::posixErrorToString(e).c_str()));
+    }
+
+    if (::ftruncate(m_fd, off_t(m_capacity)) != 0)
+    {
+        auto e = errno;
+        ::close(m_fd);
+        ::shm_unlink(m_name.c_str());
+        ErThrow(Er::Util::format("Failed to resize shared memory %s: %d %s", m_name.c_str(), e, Er::Util::posixErrorToString(e).c_str()));
+    }
+
+    auto p = ::mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (p == MAP_FAILED)
+    {
+        auto e = errno;
+        ::close(m_fd);
+        ::shm_unlink(m_name.c_str());
+        ErThrow(Er::Util::format("Failed to map shared memory %s: %d %s", m_name.c_str(), e, Er::Util::posixErrorToString(e).c_str()));
+    }
+
+    m_base = static_cast<char*>(p);
+
+    Er::Log::Info(m_log) << "Created shared memory [" << m_name << "] of " << m_capacity << " bytes";
+}
+
+std::optional<std::string> ShmArena::place(std::string_view name, unsigned size, const std::shared_ptr<const std::string>& data) noexcept
+{
+    try
+    {
+        if (!data)
+            return std::nullopt;
+
+        auto slotLength = (sizeof(Shm::SlotHeader) + data->size() + Alignment - 1) & ~(Alignment - 1);
+        if (slotLength > m_capacity)
+            return std::nullopt;
+
+        std::string key(name);
+        key.push_back('\0');
+        key.append(std::to_string(size));
+
+        std::lock_guard l(m_mutex);
+
+        auto it = m_placed.find(key);
+        if (it != m_placed.end())
+        {
+            if (it->second.data.lock() == data)
+                return it->second.ref;
+
+            // rasterized again since; the old bytes must not be handed out any more
+            m_byOffset.erase(it->second.offset);
+            release(it->second.offset);
+            m_placed.erase(it);
+        }
+
+        // wrap around instead of splitting an icon
+        if (m_head + slotLength > m_capacity)
+        {
+            if (!m_wrapped)
+            {
+                Er::Log::Info(m_log) << "Shared memory [" << m_name << "] is full, " << m_placed.size() << " icons placed; reusing the oldest slots";
+                m_wrapped = true;
+            }
+
+            m_head = 0;
+        }
+
+        // reclaim the oldest icons in the way; everything ahead of the head is older than everything behind it
+        auto victim = m_byOffset.lower_bound(m_head);
+        while ((victim != m_byOffset.end()) && (victim->first < m_head + slotLength))
+        {
+            m_placed.erase(victim->second);
+            release(victim->first);
+            victim = m_byOffset.erase(victim);
+        }
+
+        auto offset = m_head;
+        auto generation = ++m_generation;
+
+        auto h = header(offset);
+        std::atomic_ref<uint64_t>(h->generation).store(0, std::memory_order_relaxed);
+        // keeps the writes below from becoming visible before the zero
+        std::atomic_thread_fence(std::memory_order_release);
+        h->length = uint32_t(data->size());
+        h->reserved = 0;
+        std::memcpy(m_base + offset + sizeof(Shm::SlotHeader), data->data(), data->size());
+        std::atomic_ref<uint64_t>(h->generation).store(generation, std::memory_order_release);
+
+        m_head = offset + slotLength;
+
+        auto ref = Shm::makeReference(m_name, offset + sizeof(Shm::SlotHeader), uint32_t(data->size()), generation);
+        m_placed.emplace(key, Placement{ offset, data, ref });
+        m_byOffset.emplace(offset, std::move(key));
+
+        return ref;
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+
+    return std::nullopt;
+}
+
+void ShmArena::release(std::size_t offset) noexcept
+{
+    // m_mutex is held by the caller; consumers holding references to it see it's gone
+    std::atomic_ref<uint64_t>(header(offset)->generation).store(0, std::memory_order_release);
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
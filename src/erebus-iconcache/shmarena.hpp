@@ -0,0 +1,117 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+namespace Shm
+{
+
+// precedes every icon in the arena; a generation of 0 marks a slot being (re)written
+struct SlotHeader
+{
+    uint64_t generation;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SlotHeader) == 16);
+
+struct Reference
+{
+    std::string shmName;
+    uint64_t offset = 0;     // of the data; the SlotHeader is right before it
+    uint32_t length = 0;
+    uint64_t generation = 0;
+};
+
+std::string makeReference(std::string_view shmName, uint64_t offset, uint32_t length, uint64_t generation);
+std::optional<Reference> parseReference(std::string_view ref);
+
+// true if the slot at 'base' still holds what 'ref' refers to; consumers check
+// this before copying the data out and validAfterCopy() after it, since the slot
+// may be reused at any time
+bool valid(const char* base, std::size_t capacity, const Reference& ref) noexcept;
+
+// same as valid(), but orders the preceding reads of the data before the check,
+// so that a copy overlapping a rewrite of the slot is rejected
+bool validAfterCopy(const char* base, std::size_t capacity, const Reference& ref) noexcept;
+
+} // namespace Shm {}
+
+
+//
+// a POSIX shared memory object holding encoded icons for consumers
+// that asked for Protocol::ResponseMode::Shared
+//
+// Icons are written into the arena as a ring: when the end is reached, the
+// oldest icons are overwritten. Every placement gets a new generation, written
+// into the slot header and the reference, so a consumer maps the object once
+// and can tell whether the slot it's been pointed to still holds that icon
+// (see Shm::valid()). An icon is placed again if its bytes have changed since,
+// e.g. because it was rasterized again after a theme change.
+//
+
+class ShmArena final
+    : public Er::NonCopyable
+{
+public:
+    ~ShmArena();
+    explicit ShmArena(Er::Log::ILog* log, std::string_view shmName, std::size_t capacity);
+
+    // returns a reference made by Shm::makeReference() or std::nullopt if the icon doesn't fit at all
+    std::optional<std::string> place(std::string_view name, unsigned size, const std::shared_ptr<const std::string>& data) noexcept;
+
+    const std::string& name() const noexcept
+    {
+        return m_name;
+    }
+
+private:
+    static constexpr std::size_t Alignment = 16;
+
+    struct Placement
+    {
+        std::size_t offset; // of the SlotHeader
+        std::weak_ptr<const std::string> data; // what was copied; a different one means the icon has changed
+        std::string ref;
+    };
+
+    void release(std::size_t offset) noexcept;
+    Shm::SlotHeader* header(std::size_t offset) noexcept
+    {
+        return reinterpret_cast<Shm::SlotHeader*>(m_base + offset);
+    }
+
+    Er::Log::ILog* const m_log;
+    const std::string m_name;
+    const std::size_t m_capacity;
+    int m_fd = -1;
+    char* m_base = nullptr;
+    std::mutex m_mutex;
+    std::size_t m_head = 0;         // where the next icon goes
+    uint64_t m_generation = 0;
+    bool m_wrapped = false;
+    std::unordered_map<std::string, Placement> m_placed; // (name, size) -> placement
+    std::map<std::size_t, std::string> m_byOffset;        // SlotHeader offset -> (name, size)
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
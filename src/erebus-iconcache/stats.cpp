@@ -0,0 +1,177 @@
+#include "stats.hpp"
+
+#include <erebus/system/thread.hxx>
+#include <erebus/util/posixerror.hxx>
+
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+uint64_t Histogram::percentile(const std::array<uint64_t, BucketCount>& buckets, uint64_t count, double p) const noexcept
+{
+    if (!count)
+        return 0;
+
+    auto rank = uint64_t(p * double(count));
+    if (rank >= count)
+        rank = count - 1;
+
+    // report the upper bound of the bucket holding the rank
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < BucketCount; ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+            return (i < BucketCount - 1) ? std::min(uint64_t(1) << i, m_maxUs.load(std::memory_order_relaxed)) : m_maxUs.load(std::memory_order_relaxed);
+    }
+
+    return m_maxUs.load(std::memory_order_relaxed);
+}
+
+void Histogram::write(std::ostream& out, std::string_view name) const
+{
+    // not an atomic snapshot, but close enough for monitoring
+    std::array<uint64_t, BucketCount> buckets;
+    uint64_t count = 0;
+    for (std::size_t i = 0; i < BucketCount; ++i)
+    {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+
+    out << name << "_count=" << count << "\n";
+    out << name << "_sum_us=" << m_sumUs.load(std::memory_order_relaxed) << "\n";
+    out << name << "_p50_us=" << percentile(buckets, count, 0.50) << "\n";
+    out << name << "_p90_us=" << percentile(buckets, count, 0.90) << "\n";
+    out << name << "_p99_us=" << percentile(buckets, count, 0.99) << "\n";
+    out << name << "_max_us=" << m_maxUs.load(std::memory_order_relaxed) << "\n";
+}
+
+
+StatsReporter::~StatsReporter()
+{
+    m_thread.request_stop();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // the final numbers
+    if (!m_filePath.empty())
+        writeFile(collect());
+}
+
+StatsReporter::StatsReporter(Er::Log::ILog* log, std::vector<Source>&& sources, std::string_view filePath, std::chrono::seconds interval)
+    : m_log(log)
+    , m_sources(std::move(sources))
+    , m_filePath(filePath)
+    , m_interval(interval)
+    , m_thread([this](std::stop_token stop) { run(stop); })
+{
+}
+
+void StatsReporter::requestDump() noexcept
+{
+    {
+        std::lock_guard l(m_mutex);
+        m_dumpRequested = true;
+    }
+
+    m_cv.notify_one();
+}
+
+std::string StatsReporter::collect() const
+{
+    std::ostringstream out;
+    out << "# erebus-iconcache stats " << FormatVersion << "\n";
+    out << "uptime_s=" << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_started).count() << "\n";
+
+    for (auto& source : m_sources)
+        source(out);
+
+    return out.str();
+}
+
+void StatsReporter::writeFile(const std::string& text) noexcept
+{
+    auto tmpPath = m_filePath + ".tmp";
+    auto fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0)
+    {
+        auto e = errno;
+        Er::Log::Error(m_log) << "Failed to create [" << tmpPath << "]: " << e << " " << Er::Util::posixErrorToString(e);
+        return;
+    }
+
+    bool ok = (::write(fd, text.data(), text.size()) == ssize_t(text.size()));
+    ::close(fd);
+
+    if (!ok || (::rename(tmpPath.c_str(), m_filePath.c_str()) != 0))
+    {
+        auto e = errno;
+        Er::Log::Error(m_log) << "Failed to write [" << m_filePath << "]: " << e << " " << Er::Util::posixErrorToString(e);
+        ::unlink(tmpPath.c_str());
+    }
+}
+
+void StatsReporter::run(std::stop_token stop) noexcept
+{
+    Er::System::CurrentThread::setName("iconcache_stats");
+
+    try
+    {
+        auto nextWrite = std::chrono::steady_clock::now() + m_interval;
+
+        while (!stop.stop_requested())
+        {
+            bool dump = false;
+
+            {
+                std::unique_lock l(m_mutex);
+
+                auto wake = [this, &stop]() { return m_dumpRequested || stop.stop_requested(); };
+                if (m_filePath.empty())
+                    m_cv.wait(l, stop, wake);
+                else
+                    m_cv.wait_until(l, stop, nextWrite, wake);
+
+                if (stop.stop_requested())
+                    break;
+
+                dump = m_dumpRequested;
+                m_dumpRequested = false;
+            }
+
+            if (dump)
+            {
+                std::istringstream lines(collect());
+                std::string line;
+                while (std::getline(lines, line))
+                    Er::Log::Info(m_log) << line;
+            }
+
+            if (!m_filePath.empty() && (std::chrono::steady_clock::now() >= nextWrite))
+            {
+                writeFile(collect());
+                nextWrite = std::chrono::steady_clock::now() + m_interval;
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        Er::Log::Error(m_log) << "Unexpected exception: " << e.what();
+    }
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
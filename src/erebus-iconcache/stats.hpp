@@ -0,0 +1,113 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// lock-free latency histogram with power-of-2 microsecond buckets;
+// recording is a couple of relaxed atomic adds
+//
+
+class Histogram final
+    : public Er::NonCopyable
+{
+public:
+    Histogram() noexcept = default;
+
+    void record(std::chrono::steady_clock::duration d) noexcept
+    {
+        auto us = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+
+        // bucket i holds [2^(i-1), 2^i) us; bucket 0 holds < 1 us
+        auto bucket = std::min<std::size_t>(std::size_t(std::bit_width(us)), BucketCount - 1);
+
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_sumUs.fetch_add(us, std::memory_order_relaxed);
+
+        auto max = m_maxUs.load(std::memory_order_relaxed);
+        while ((us > max) && !m_maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // <name>_count, <name>_sum_us, <name>_p50_us, <name>_p90_us, <name>_p99_us, <name>_max_us
+    void write(std::ostream& out, std::string_view name) const;
+
+private:
+    static constexpr std::size_t BucketCount = 26; // the last one is everything >= 2^24 us (~16 s)
+
+    uint64_t percentile(const std::array<uint64_t, BucketCount>& buckets, uint64_t count, double p) const noexcept;
+
+    std::array<std::atomic<uint64_t>, BucketCount> m_buckets = {};
+    std::atomic<uint64_t> m_sumUs = 0;
+    std::atomic<uint64_t> m_maxUs = 0;
+};
+
+
+//
+// collects key=value lines from the daemon's components; writes them to
+// the log on request (SIGUSR1) and periodically to a file, if configured
+//
+// The file is replaced atomically and looks like
+//   # erebus-iconcache stats 1
+//   uptime_s=123
+//   <key>=<value>
+//   ...
+// Keys are never renamed or reused for something else.
+//
+
+class StatsReporter final
+    : public Er::NonCopyable
+{
+public:
+    using Source = std::function<void(std::ostream&)>;
+
+    ~StatsReporter();
+    explicit StatsReporter(Er::Log::ILog* log, std::vector<Source>&& sources, std::string_view filePath, std::chrono::seconds interval);
+
+    // may be called from any thread
+    void requestDump() noexcept;
+
+private:
+    static constexpr unsigned FormatVersion = 1;
+
+    std::string collect() const;
+    void writeFile(const std::string& text) noexcept;
+    void run(std::stop_token stop) noexcept;
+
+    Er::Log::ILog* const m_log;
+    const std::vector<Source> m_sources;
+    const std::string m_filePath;
+    const std::chrono::seconds m_interval;
+    const std::chrono::steady_clock::time_point m_started = std::chrono::steady_clock::now();
+    std::mutex m_mutex;
+    std::condition_variable_any m_cv;
+    bool m_dumpRequested = false;
+    std::jthread m_thread;
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
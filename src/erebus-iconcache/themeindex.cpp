@@ -0,0 +1,365 @@
+#include "themeindex.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+
+#include <boost/algorithm/string.hpp>
+
+#include <sys/stat.h>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+namespace
+{
+
+// section -> key -> value
+using IniFile = std::map<std::string, std::map<std::string, std::string>>;
+
+bool parseIni(const std::filesystem::path& path, IniFile& ini)
+{
+    std::ifstream f(path);
+    if (!f)
+        return false;
+
+    std::string line;
+    std::map<std::string, std::string>* section = nullptr;
+    while (std::getline(f, line))
+    {
+        boost::trim(line);
+        if (line.empty() || (line.front() == '#'))
+            continue;
+
+        if ((line.front() == '[') && (line.back() == ']'))
+        {
+            section = &ini[line.substr(1, line.size() - 2)];
+            continue;
+        }
+
+        auto eq = line.find('=');
+        if (!section || (eq == std::string::npos))
+            continue;
+
+        auto key = line.substr(0, eq);
+        auto value = line.substr(eq + 1);
+        boost::trim(key);
+        boost::trim(value);
+        (*section)[key] = value;
+    }
+
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string& value)
+{
+    std::vector<std::string> items;
+    boost::split(items, value, [](char c) { return (c == ','); });
+
+    std::vector<std::string> result;
+    for (auto& item : items)
+    {
+        boost::trim(item);
+        if (!item.empty())
+            result.push_back(std::move(item));
+    }
+
+    return result;
+}
+
+unsigned toUnsigned(const std::map<std::string, std::string>& section, const char* key, unsigned def)
+{
+    auto it = section.find(key);
+    if (it == section.end())
+        return def;
+
+    auto v = std::strtoul(it->second.c_str(), nullptr, 10);
+    return v ? unsigned(v) : def;
+}
+
+std::optional<std::timespec> mtimeOf(const std::string& path) noexcept
+{
+    struct stat st = {};
+    if (::stat(path.c_str(), &st) != 0)
+        return std::nullopt;
+
+    return st.st_mtim;
+}
+
+} // namespace {}
+
+
+ThemeIndex::ThemeIndex(Er::Log::ILog* log, std::string_view themeName, const std::vector<std::string>& searchPaths)
+    : m_log(log)
+    , m_themeName(themeName)
+    , m_searchPaths(searchPaths)
+    , m_snapshot(build())
+{
+}
+
+bool ThemeIndex::valid() const
+{
+    std::lock_guard l(m_mutex);
+    return !m_snapshot->themes.empty() && (m_snapshot->themes.front() == m_themeName);
+}
+
+std::vector<std::string> ThemeIndex::names() const
+{
+    std::shared_ptr<const Snapshot> snapshot;
+    {
+        std::lock_guard l(m_mutex);
+        snapshot = m_snapshot;
+    }
+
+    std::vector<std::string> result;
+    result.reserve(snapshot->icons.size());
+    for (auto& icon : snapshot->icons)
+        result.push_back(icon.first);
+
+    return result;
+}
+
+std::optional<std::string> ThemeIndex::lookup(std::string_view name, unsigned size) const
+{
+    std::shared_ptr<const Snapshot> snapshot;
+    {
+        std::lock_guard l(m_mutex);
+        snapshot = m_snapshot;
+    }
+
+    auto it = snapshot->icons.find(std::string(name));
+    if (it == snapshot->icons.end())
+        return std::nullopt;
+
+    // locations are ordered by theme; only the first theme having the name counts
+    auto& locations = it->second;
+    auto theme = locations.front().theme;
+    const Location* closest = nullptr;
+    unsigned closestDistance = 0;
+    for (auto& location : locations)
+    {
+        if (location.theme != theme)
+            break;
+
+        auto& dir = snapshot->directories[location.directory];
+        if (matchesSize(dir, size))
+            return location.path;
+
+        auto distance = sizeDistance(dir, size);
+        if (!closest || (distance < closestDistance))
+        {
+            closest = &location;
+            closestDistance = distance;
+        }
+    }
+
+    return closest->path;
+}
+
+bool ThemeIndex::refreshIfChanged()
+{
+    std::shared_ptr<const Snapshot> snapshot;
+    {
+        std::lock_guard l(m_mutex);
+        snapshot = m_snapshot;
+    }
+
+    bool changed = false;
+    for (auto& [path, mtime] : snapshot->watched)
+    {
+        auto current = mtimeOf(path);
+        if (!current || (current->tv_sec != mtime.tv_sec) || (current->tv_nsec != mtime.tv_nsec))
+        {
+            Er::Log::Info(m_log) << "[" << path << "] has changed; rebuilding theme index";
+            changed = true;
+            break;
+        }
+    }
+
+    if (!changed)
+        return false;
+
+    auto rebuilt = build();
+
+    std::lock_guard l(m_mutex);
+    m_snapshot = rebuilt;
+
+    return true;
+}
+
+std::shared_ptr<const ThemeIndex::Snapshot> ThemeIndex::build() const
+{
+    auto snapshot = std::make_shared<Snapshot>();
+
+    // a theme may be added to a search path later
+    for (auto& root : m_searchPaths)
+    {
+        auto mtime = mtimeOf(root);
+        if (mtime)
+            snapshot->watched.emplace_back(root, *mtime);
+    }
+
+    // depth-first over Inherits=, then hicolor as the ultimate fallback
+    std::set<std::string> visited;
+    std::vector<std::string> pending{ m_themeName };
+    while (!pending.empty())
+    {
+        auto theme = std::move(pending.back());
+        pending.pop_back();
+
+        if (theme.empty() || !visited.insert(theme).second)
+            continue;
+
+        std::vector<std::string> inherits;
+        parseTheme(*snapshot, theme, inherits);
+
+        for (auto it = inherits.rbegin(); it != inherits.rend(); ++it)
+            pending.push_back(std::move(*it));
+
+        if (pending.empty() && !visited.contains("hicolor"))
+            pending.push_back("hicolor");
+    }
+
+    std::size_t locations = 0;
+    for (auto& icon : snapshot->icons)
+        locations += icon.second.size();
+
+    Er::Log::Info(m_log) << "Indexed " << snapshot->icons.size() << " icon names (" << locations << " files) in " << snapshot->directories.size() << " directories of theme [" << m_themeName << "] and " << (snapshot->themes.empty() ? 0 : snapshot->themes.size() - 1) << " inherited themes";
+
+    return snapshot;
+}
+
+void ThemeIndex::parseTheme(Snapshot& snapshot, const std::string& theme, std::vector<std::string>& inherits) const
+{
+    // the first index.theme found describes the theme for all the search paths
+    IniFile ini;
+    bool found = false;
+    for (auto& root : m_searchPaths)
+    {
+        auto indexPath = std::filesystem::path(root) / theme / "index.theme";
+        if (parseIni(indexPath, ini))
+        {
+            auto mtime = mtimeOf(indexPath.string());
+            if (mtime)
+                snapshot.watched.emplace_back(indexPath.string(), *mtime);
+
+            found = true;
+            break;
+        }
+    }
+
+    if (!found)
+    {
+        Er::Log::Warning(m_log) << "No index.theme found for theme [" << theme << "]";
+        return;
+    }
+
+    auto themeNo = uint32_t(snapshot.themes.size());
+    snapshot.themes.push_back(theme);
+
+    auto& header = ini["Icon Theme"];
+    inherits = splitList(header["Inherits"]);
+
+    for (auto& subdir : splitList(header["Directories"]))
+    {
+        auto section = ini.find(subdir);
+        if (section == ini.end())
+            continue;
+
+        // we rasterize at 1x only
+        if (toUnsigned(section->second, "Scale", 1) != 1)
+            continue;
+
+        Directory dir;
+        dir.size = toUnsigned(section->second, "Size", 0);
+        if (!dir.size)
+            continue;
+
+        dir.minSize = toUnsigned(section->second, "MinSize", dir.size);
+        dir.maxSize = toUnsigned(section->second, "MaxSize", dir.size);
+        dir.threshold = toUnsigned(section->second, "Threshold", 2);
+
+        auto type = section->second.find("Type");
+        if (type != section->second.end())
+        {
+            if (type->second == "Fixed")
+                dir.type = DirType::Fixed;
+            else if (type->second == "Scalable")
+                dir.type = DirType::Scalable;
+        }
+
+        auto dirNo = uint32_t(snapshot.directories.size());
+        snapshot.directories.push_back(dir);
+
+        for (auto& root : m_searchPaths)
+        {
+            auto path = std::filesystem::path(root) / theme / subdir;
+
+            std::error_code ec;
+            std::filesystem::directory_iterator it(path, ec);
+            if (ec)
+                continue;
+
+            auto mtime = mtimeOf(path.string());
+            if (mtime)
+                snapshot.watched.emplace_back(path.string(), *mtime);
+
+            for (auto& entry : it)
+            {
+                auto ext = entry.path().extension();
+                if ((ext != ".png") && (ext != ".svg") && (ext != ".svgz") && (ext != ".xpm"))
+                    continue;
+
+                snapshot.icons[entry.path().stem().string()].push_back(Location{ themeNo, dirNo, entry.path().string() });
+            }
+        }
+    }
+}
+
+bool ThemeIndex::matchesSize(const Directory& dir, unsigned size) noexcept
+{
+    switch (dir.type)
+    {
+    case DirType::Fixed:
+        return dir.size == size;
+    case DirType::Scalable:
+        return (dir.minSize <= size) && (size <= dir.maxSize);
+    case DirType::Threshold:
+        return (dir.size <= size + dir.threshold) && (size <= dir.size + dir.threshold);
+    }
+
+    return false;
+}
+
+unsigned ThemeIndex::sizeDistance(const Directory& dir, unsigned size) noexcept
+{
+    switch (dir.type)
+    {
+    case DirType::Fixed:
+        return (dir.size > size) ? (dir.size - size) : (size - dir.size);
+    case DirType::Scalable:
+        if (size < dir.minSize)
+            return dir.minSize - size;
+        if (size > dir.maxSize)
+            return size - dir.maxSize;
+        return 0;
+    case DirType::Threshold:
+        if (size + dir.threshold < dir.size)
+            return dir.size - dir.threshold - size;
+        if (size > dir.size + dir.threshold)
+            return size - dir.size - dir.threshold;
+        return 0;
+    }
+
+    return 0;
+}
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <erebus/log.hxx>
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Erp
+{
+
+namespace IconCache
+{
+
+
+//
+// name -> (size, path) index over an XDG icon theme and everything it inherits
+//
+// Built once by parsing index.theme files and listing the theme directories,
+// so a lookup is a hash probe plus a scan over the few directories holding
+// that name. Lookups follow the icon theme spec: the first theme in the
+// inheritance chain that has the name wins, and within it the directory that
+// matches the size, or failing that the closest one.
+//
+
+class ThemeIndex final
+    : public Er::NonCopyable
+{
+public:
+    explicit ThemeIndex(Er::Log::ILog* log, std::string_view themeName, const std::vector<std::string>& searchPaths);
+
+    // std::nullopt if the icon is not in the theme chain
+    std::optional<std::string> lookup(std::string_view name, unsigned size) const;
+
+    // rebuilds the index if any theme directory has changed since it was built
+    bool refreshIfChanged();
+
+    // false if no index.theme was found at all
+    bool valid() const;
+
+    std::vector<std::string> names() const;
+
+private:
+    enum class DirType
+    {
+        Fixed,
+        Scalable,
+        Threshold
+    };
+
+    struct Directory
+    {
+        unsigned size = 0;
+        unsigned minSize = 0;
+        unsigned maxSize = 0;
+        unsigned threshold = 2;
+        DirType type = DirType::Threshold;
+    };
+
+    struct Location
+    {
+        uint32_t theme;     // position in the inheritance chain
+        uint32_t directory; // in Snapshot::directories
+        std::string path;
+    };
+
+    struct Snapshot
+    {
+        std::vector<std::string> themes; // inheritance chain, most specific first
+        std::vector<Directory> directories;
+        std::unordered_map<std::string, std::vector<Location>> icons;
+        std::vector<std::pair<std::string, std::timespec>> watched; // directory -> mtime
+    };
+
+    std::shared_ptr<const Snapshot> build() const;
+    void parseTheme(Snapshot& snapshot, const std::string& theme, std::vector<std::string>& inherits) const;
+    static bool matchesSize(const Directory& dir, unsigned size) noexcept;
+    static unsigned sizeDistance(const Directory& dir, unsigned size) noexcept;
+
+    Er::Log::ILog* const m_log;
+    const std::string m_themeName;
+    const std::vector<std::string> m_searchPaths;
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const Snapshot> m_snapshot;
+};
+
+
+} // namespace IconCache {}
+
+} // namespace Erp {}
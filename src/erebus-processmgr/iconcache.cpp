@@ -1,52 +1,107 @@
 #include "iconcache.hpp"
 
 #include <erebus/util/exceptionutil.hxx>
-#include <erebus/system/thread.hxx>
 #include <erebus-desktop/erebus-desktop.hxx>
+#include <erebus-gui/rawicon.hpp>
 
 #include <QPixmap>
 
+#include <algorithm>
+#include <optional>
+
 
 namespace Erp::ProcessMgr
 {
 
 IconCache::~IconCache()
 {
+    {
+        std::unique_lock l(m_mutex);
+        m_stopping = true;
+        m_pending.clear();
+        m_idle.wait(l, [this]() { return m_inFlight == 0; });
+    }
+
+    logStats();
 }
 
-IconCache::IconCache(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
-    : m_client(Er::Client::createClient(channel, log))
+IconCache::IconCache(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const Params& params)
+    : m_executor(executor)
     , m_log(log)
-    , m_worker(std::jthread([this](std::stop_token stop) { worker(stop); }))
+    , m_params(std::max(params.maxInFlight, 1U))
+    , m_lastStatsLogged(Clock::now().time_since_epoch().count())
 {
+    // fetches run in parallel, and a client isn't meant to be used from several threads at once
+    m_clients.reserve(m_params.maxInFlight);
+    for (unsigned i = 0; i < m_params.maxInFlight; ++i)
+        m_clients.push_back(Er::Client::createClient(channel, log));
 }
 
-void IconCache::worker(std::stop_token stop) noexcept
+void IconCache::dispatch() noexcept
 {
-    Er::System::CurrentThread::setName("IconCache");
-
-    Er::Log::debug(m_log, "IconCache worker started");
-
+    // m_mutex is held by the caller; every fetch is a task of its own on the shared executor
     try
     {
-        while (!stop.stop_requested())
+        while (!m_stopping && !m_pending.empty() && (m_inFlight < m_params.maxInFlight))
         {
-            std::unique_lock l(m_mutex);
+            if (m_visibleChanged.exchange(false, std::memory_order_acq_rel))
+                reprioritize();
 
-            if (m_pendingCv.wait(l, stop, [this]() { return !m_pending.empty(); }))
+            std::pop_heap(m_pending.begin(), m_pending.end());
+            auto& next = m_pending.back();
+
+            try
+            {
+                // the task can't start before we release m_mutex, so counting it afterwards is safe
+                m_executor->post([this, client = m_clients.back(), process = next.process, queued = next.queued]() mutable { fetch(std::move(client), std::move(process), queued); });
+            }
+            catch (...)
             {
-                auto process = m_pending.front();
-                m_pending.pop();
+                // keep it queued; the next completed fetch or request dispatches it again
+                std::push_heap(m_pending.begin(), m_pending.end());
+                throw;
+            }
 
-                auto icon = requestIcon(process->pid);
+            ++m_inFlight;
+            m_clients.pop_back();
+            m_pending.pop_back();
+        }
+    }
+    catch (std::exception& e)
+    {
+        Er::Util::logException(m_log, Er::Log::Level::Warning, e);
+    }
+}
 
-                {
-                    Er::ObjectLock<ProcessInfo> locked(*process);
+void IconCache::fetch(std::shared_ptr<Er::Client::IClient> client, ProcessInfoPtr process, Clock::time_point queued) noexcept
+{
+    try
+    {
+        auto started = Clock::now();
 
-                    if (locked->icon.state != ProcessInfo::IconData::State::Valid)
-                        locked->icon = std::move(icon);
-                }
+        bool failed = false;
+        std::optional<ProcessInformation::IconData> icon;
+        if (!exited(process))
+            icon = requestIcon(client.get(), process->pid, failed);
+        else
+            Er::Log::debug(m_log, "Skipping icon for exited PID {}", process->pid);
+
+        auto finished = Clock::now();
+
+        if (icon)
+        {
+            {
+                Er::ObjectLock<ProcessInfo> locked(*process);
+
+                if (locked->icon.state != ProcessInfo::IconData::State::Valid)
+                    locked->icon = std::move(*icon);
             }
+
+            account(
+                std::chrono::duration_cast<std::chrono::microseconds>(started - queued),
+                std::chrono::duration_cast<std::chrono::microseconds>(finished - started),
+                failed
+            );
         }
     }
     catch (Er::Exception& e)
@@ -58,12 +113,151 @@ void IconCache::worker(std::stop_token stop) noexcept
         Er::Util::logException(m_log, Er::Log::Level::Warning, e);
     }
 
-    Er::Log::debug(m_log, "IconCache worker exited");
+    std::lock_guard l(m_mutex);
+
+    m_clients.push_back(std::move(client));
+    --m_inFlight;
+    dispatch();
+
+    if (m_stopping && !m_inFlight)
+        m_idle.notify_all(); // the destructor may run as soon as the lock is released
+}
+
+void IconCache::updateMax(std::atomic<int64_t>& max, int64_t value) noexcept
+{
+    auto prev = max.load(std::memory_order_relaxed);
+    while ((prev < value) && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+    {
+    }
 }
 
-ProcessInformation::IconData IconCache::requestIcon(uint64_t pid) noexcept
+void IconCache::account(std::chrono::microseconds queueWait, std::chrono::microseconds rpc, bool failed) noexcept
+{
+    m_counters.fetched.fetch_add(1, std::memory_order_relaxed);
+    if (failed)
+        m_counters.failed.fetch_add(1, std::memory_order_relaxed);
+
+    m_counters.queueWaitTotal.fetch_add(queueWait.count(), std::memory_order_relaxed);
+    updateMax(m_counters.queueWaitMax, queueWait.count());
+
+    m_counters.rpcTotal.fetch_add(rpc.count(), std::memory_order_relaxed);
+    updateMax(m_counters.rpcMax, rpc.count());
+
+    // whoever notices the interval has passed logs the summary
+    auto now = Clock::now().time_since_epoch().count();
+    auto last = m_lastStatsLogged.load(std::memory_order_relaxed);
+    auto interval = std::chrono::duration_cast<Clock::duration>(StatsInterval).count();
+    if ((now - last >= interval) && m_lastStatsLogged.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        logStats();
+}
+
+IconCache::Stats IconCache::stats() const noexcept
+{
+    Stats s;
+    s.fetched = m_counters.fetched.load(std::memory_order_relaxed);
+    s.failed = m_counters.failed.load(std::memory_order_relaxed);
+    s.queueWaitTotal = std::chrono::microseconds(m_counters.queueWaitTotal.load(std::memory_order_relaxed));
+    s.queueWaitMax = std::chrono::microseconds(m_counters.queueWaitMax.load(std::memory_order_relaxed));
+    s.rpcTotal = std::chrono::microseconds(m_counters.rpcTotal.load(std::memory_order_relaxed));
+    s.rpcMax = std::chrono::microseconds(m_counters.rpcMax.load(std::memory_order_relaxed));
+    return s;
+}
+
+void IconCache::logStats() noexcept
+{
+    auto s = stats();
+    if (!s.fetched)
+        return;
+
+    Er::Log::info(
+        m_log,
+        "Icons: {} fetched, {} failed; queue wait avg {} ms, max {} ms; RPC avg {} ms, max {} ms",
+        s.fetched,
+        s.failed,
+        s.queueWaitTotal.count() / 1000.0 / s.fetched,
+        s.queueWaitMax.count() / 1000.0,
+        s.rpcTotal.count() / 1000.0 / s.fetched,
+        s.rpcMax.count() / 1000.0
+    );
+}
+
+bool IconCache::exited(const ProcessInfoPtr& process) noexcept
+{
+    Er::ObjectLock<ProcessInfo> locked(*process);
+
+    return (locked->state() == ProcessInfo::State::Deleted);
+}
+
+unsigned IconCache::rankOf(uint64_t pid) noexcept
+{
+    std::lock_guard l(m_visibleMutex);
+
+    auto it = m_visible.find(pid);
+    if (it == m_visible.end())
+        return Invisible;
+
+    return it->second;
+}
+
+void IconCache::reprioritize() noexcept
+{
+    // m_mutex is held by the caller
+    {
+        std::lock_guard l(m_visibleMutex);
+
+        for (auto& p : m_pending)
+        {
+            auto it = m_visible.find(p.pid);
+            p.rank = (it == m_visible.end()) ? Invisible : it->second;
+        }
+    }
+
+    std::make_heap(m_pending.begin(), m_pending.end());
+}
+
+void IconCache::prioritize(const std::vector<uint64_t>& visible) noexcept
+{
+    try
+    {
+        std::unordered_map<uint64_t, unsigned> ranks;
+        ranks.reserve(visible.size());
+
+        unsigned rank = 0;
+        for (auto pid : visible)
+            ranks.insert({ pid, rank++ });
+
+        {
+            std::lock_guard l(m_visibleMutex);
+            m_visible.swap(ranks);
+        }
+
+        // the pending queue is reordered before the next dispatch
+        m_visibleChanged.store(true, std::memory_order_release);
+    }
+    catch (std::exception& e)
+    {
+        Er::Util::logException(m_log, Er::Log::Level::Warning, e);
+    }
+}
+
+void IconCache::cancel(uint64_t pid) noexcept
+{
+    std::unique_lock l(m_mutex);
+
+    auto it = std::remove_if(m_pending.begin(), m_pending.end(), [pid](const Pending& p) { return p.pid == pid; });
+    if (it != m_pending.end())
+    {
+        m_pending.erase(it, m_pending.end());
+        std::make_heap(m_pending.begin(), m_pending.end());
+
+        Er::Log::debug(m_log, "Cancelled icon request for PID {}", pid);
+    }
+}
+
+ProcessInformation::IconData IconCache::requestIcon(Er::Client::IClient* client, uint64_t pid, bool& failed) noexcept
 {
     ProcessInformation::IconData result;
+    failed = false;
 
     try
     {
@@ -71,12 +265,13 @@ ProcessInformation::IconData IconCache::requestIcon(uint64_t pid) noexcept
         Er::addProperty<Er::Desktop::Props::IconSize>(req, uint32_t(Er::Desktop::IconSize::Small));
         Er::addProperty<Er::Desktop::Props::Pid>(req, pid);
 
-        auto reply = m_client->request(Er::Desktop::Requests::QueryIcon, req);
+        auto reply = client->request(Er::Desktop::Requests::QueryIcon, req);
 
         auto status = Er::getPropertyValue<Er::Desktop::Props::IconState>(reply);
         if (!status)
         {
             Er::Log::error(m_log, "No icon status returned for PID {}", pid);
+            failed = true;
             result.state = ProcessInformation::IconData::State::Invalid;
             return result;
         }
@@ -93,8 +288,12 @@ ProcessInformation::IconData IconCache::requestIcon(uint64_t pid) noexcept
             auto rawIcon = Er::getPropertyValue<Er::Desktop::Props::Icon>(reply);
             if (rawIcon)
             {
+                // the daemon may be keeping icons as raw ARGB32 rather than PNG
                 QPixmap pixmap;
-                if (!pixmap.loadFromData(reinterpret_cast<const uchar*>(rawIcon->data()), rawIcon->size()))
+                auto image = Erc::RawIcon::wrap(rawIcon->data(), rawIcon->size());
+                if (!image.isNull())
+                    pixmap = QPixmap::fromImage(image); // copies the pixels out of the reply
+                else if (!pixmap.loadFromData(reinterpret_cast<const uchar*>(rawIcon->data()), rawIcon->size()))
                 {
                     Er::Log::warning(m_log, "Failed to load icon for PID {}", pid);
                     result.state = ProcessInformation::IconData::State::Invalid;
@@ -114,10 +313,12 @@ ProcessInformation::IconData IconCache::requestIcon(uint64_t pid) noexcept
     catch (Er::Exception& e)
     {
         Er::Util::logException(m_log, Er::Log::Level::Warning, e);
+        failed = true;
     }
     catch (std::exception& e)
     {
         Er::Util::logException(m_log, Er::Log::Level::Warning, e);
+        failed = true;
     }
 
     result.state = ProcessInformation::IconData::State::Invalid;
@@ -137,13 +338,15 @@ void IconCache::requestIcon(ProcessInfoPtr process) noexcept
             }
         }
 
-        {
-            std::unique_lock l(m_mutex);
+        auto pid = process->pid;
+        auto rank = rankOf(pid);
 
-            m_pending.push(process);
-        }
+        std::unique_lock l(m_mutex);
+
+        m_pending.push_back(Pending{ std::move(process), pid, rank, m_seq++, Clock::now() });
+        std::push_heap(m_pending.begin(), m_pending.end());
 
-        m_pendingCv.notify_one();
+        dispatch();
     }
     catch (Er::Exception& e)
     {
@@ -4,11 +4,14 @@
 
 #include <erebus/log.hxx>
 #include <erebus-clt/erebus-clt.hxx>
+#include <erebus-gui/executor.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
-#include <thread>
+#include <unordered_map>
+#include <vector>
 
 
 namespace Erp::ProcessMgr
@@ -22,21 +25,101 @@ public:
     using ProcessInfo = LockableTrackableProcessInformation;
     using ProcessInfoPtr = LockableTrackableProcessInformationPtr;
 
+    struct Params
+    {
+        unsigned maxInFlight = 2; // outstanding RPCs on this channel, i.e. executor tasks
+
+        constexpr Params() noexcept = default;
+
+        constexpr explicit Params(unsigned maxInFlight) noexcept
+            : maxInFlight(maxInFlight)
+        {}
+    };
+
+    struct Stats
+    {
+        uint64_t fetched = 0;
+        uint64_t failed = 0;
+        std::chrono::microseconds queueWaitTotal = {};
+        std::chrono::microseconds queueWaitMax = {};
+        std::chrono::microseconds rpcTotal = {};
+        std::chrono::microseconds rpcMax = {};
+    };
+
+    // waits for the fetches in flight
     ~IconCache();
-    explicit IconCache(Er::Client::ChannelPtr channel, Er::Log::ILog* log);
+    explicit IconCache(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const Params& params = Params());
 
     void requestIcon(ProcessInfoPtr process) noexcept;
 
+    // PIDs of the rows currently visible in the view, top to bottom;
+    // their icons are fetched first
+    void prioritize(const std::vector<uint64_t>& visible) noexcept;
+
+    // the process has exited; don't bother fetching its icon
+    void cancel(uint64_t pid) noexcept;
+
+    Stats stats() const noexcept;
+
 private:
-    void worker(std::stop_token stop) noexcept;
-    ProcessInformation::IconData requestIcon(uint64_t pid) noexcept;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr unsigned Invisible = unsigned(-1);
+    static constexpr std::chrono::seconds StatsInterval = std::chrono::seconds(30);
+
+    struct Pending
+    {
+        ProcessInfoPtr process;
+        uint64_t pid;
+        unsigned rank;  // row position in the viewport; Invisible if not shown
+        uint64_t seq;   // FIFO order among equal ranks
+        Clock::time_point queued;
+
+        // std::push_heap() builds a max-heap, so 'less' means 'fetched later'
+        bool operator<(const Pending& o) const noexcept
+        {
+            if (rank != o.rank)
+                return rank > o.rank;
+
+            return seq > o.seq;
+        }
+    };
+
+    struct Counters
+    {
+        std::atomic<uint64_t> fetched = 0;
+        std::atomic<uint64_t> failed = 0;
+        std::atomic<int64_t> queueWaitTotal = 0; // usec
+        std::atomic<int64_t> queueWaitMax = 0;
+        std::atomic<int64_t> rpcTotal = 0;
+        std::atomic<int64_t> rpcMax = 0;
+    };
+
+    void dispatch() noexcept;
+    void fetch(std::shared_ptr<Er::Client::IClient> client, ProcessInfoPtr process, Clock::time_point queued) noexcept;
+    ProcessInformation::IconData requestIcon(Er::Client::IClient* client, uint64_t pid, bool& failed) noexcept;
+    unsigned rankOf(uint64_t pid) noexcept;
+    void reprioritize() noexcept;
+    bool exited(const ProcessInfoPtr& process) noexcept;
+    void account(std::chrono::microseconds queueWait, std::chrono::microseconds rpc, bool failed) noexcept;
+    void logStats() noexcept;
+    static void updateMax(std::atomic<int64_t>& max, int64_t value) noexcept;
 
-    std::shared_ptr<Er::Client::IClient> m_client;
+    Erc::IExecutor* const m_executor;
     Er::Log::ILog* const m_log;
+    const Params m_params;
     std::mutex m_mutex;
-    std::condition_variable_any m_pendingCv;
-    std::jthread m_worker;
-    std::queue<ProcessInfoPtr> m_pending;
+    std::condition_variable m_idle;
+    std::vector<Pending> m_pending; // heap
+    uint64_t m_seq = 0;
+    unsigned m_inFlight = 0;
+    std::vector<std::shared_ptr<Er::Client::IClient>> m_clients; // idle ones; every fetch in flight has one to itself
+    bool m_stopping = false;
+    std::mutex m_visibleMutex; // the GUI thread only ever takes this one
+    std::unordered_map<uint64_t, unsigned> m_visible; // pid -> rank
+    std::atomic<bool> m_visibleChanged = false;
+    Counters m_counters;
+    std::atomic<Clock::rep> m_lastStatsLogged;
 };
 
 
@@ -18,11 +18,11 @@ class ProcessListImpl
 public:
     ~ProcessListImpl() = default;
 
-    explicit ProcessListImpl(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
+    explicit ProcessListImpl(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const IconCache::Params& iconParams)
         : m_client(Er::Client::createClient(channel, log))
         , m_log(log)
         , m_mutexPool(MutexPoolSize)
-        , m_iconCache(channel, log)
+        , m_iconCache(channel, executor, log, iconParams)
     {
     }
 
@@ -40,6 +40,11 @@ public:
         return diff;
     }
 
+    void prioritizeIcons(const std::vector<uint64_t>& visible) noexcept override
+    {
+        m_iconCache.prioritize(visible);
+    }
+
 private:
     using ItemContainer = std::unordered_map<typename Item::Key, std::shared_ptr<Item>>;
     
@@ -118,11 +123,16 @@ private:
                     if (existing != m_collection.end())
                     {
                         // the process has exited; place it into the 'deleted' list unless it's already there
-                        Er::ObjectLock<Item> item(existing->second.get());
-                        Q_ASSERT(!item->deleted);
-                        item->markDeleted(now);
-                        m_tracked.insert({ item->pid, existing->second });
-                        diff->tracked.insert(existing->second);
+                        {
+                            Er::ObjectLock<Item> item(existing->second.get());
+                            Q_ASSERT(!item->deleted);
+                            item->markDeleted(now);
+                            m_tracked.insert({ item->pid, existing->second });
+                            diff->tracked.insert(existing->second);
+                        }
+
+                        // not under the item lock: the icon cache takes item locks while holding its own
+                        m_iconCache.cancel(parsedProcess->pid);
                     }
                     else
                     {
@@ -234,7 +244,7 @@ private:
     }
 
 
-    std::shared_ptr<Er::Client::IClient> m_client;
+    std::shared_ptr<Er::Client::IClient> m_client; // collect() only; the icon cache has its own
     Er::Log::ILog* m_log;
     static constexpr size_t MutexPoolSize = 5;
     Er::MutexPool<std::recursive_mutex> m_mutexPool;
@@ -250,9 +260,9 @@ private:
 } // namespace {}
 
 
-std::unique_ptr<IProcessList> createProcessList(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
+std::unique_ptr<IProcessList> createProcessList(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const IconCache::Params& iconParams)
 {
-    return std::make_unique<ProcessListImpl>(channel, log);
+    return std::make_unique<ProcessListImpl>(channel, executor, log, iconParams);
 }
 
 } // namespace Erp::ProcessMgr {}
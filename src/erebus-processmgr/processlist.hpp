@@ -2,10 +2,12 @@
 
 #include <erebus-clt/erebus-clt.hxx>
 
+#include "iconcache.hpp"
 #include "posixresult.hpp"
 #include "processinfo.hpp"
 
 #include <set>
+#include <vector>
 
 
 namespace Erp::ProcessMgr
@@ -58,10 +60,11 @@ struct IProcessList
 
     virtual ~IProcessList() {}
     virtual std::shared_ptr<Changeset> collect(Er::ProcessMgr::ProcessProps::PropMask required, std::chrono::milliseconds trackThreshold) = 0;
+    virtual void prioritizeIcons(const std::vector<uint64_t>& visible) noexcept = 0; // may be called from any thread
 };
 
 
-std::unique_ptr<IProcessList> createProcessList(Er::Client::ChannelPtr channel, Er::Log::ILog* log);
+std::unique_ptr<IProcessList> createProcessList(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const IconCache::Params& iconParams);
 
 } // namespace Erp::ProcessMgr {}
 
@@ -7,6 +7,7 @@
 #include "client-version.h"
 
 #include <erebus-desktop/erebus-desktop.hxx>
+#include <erebus-gui/lazypage.hpp>
 #include <erebus-processmgr/erebus-processmgr.hxx>
 
 #include <unordered_map>
@@ -26,6 +27,9 @@ class ProcessMgrPlugin final
 public:
     ~ProcessMgrPlugin()
     {
+        for (auto& pending : m_pending)
+            removePage(pending.second.page);
+
         delete m_menuProcess;
         Er::Desktop::Props::Private::unregisterAll(m_params.log);
         Er::ProcessMgr::Private::unregisterAll(m_params.log);
@@ -106,18 +110,36 @@ public:
 
     void addConnection(Er::Client::ChannelPtr channel, const std::string& endpoint) override
     {
-        auto it = m_tabs.find(channel.get());
-        if (it != m_tabs.end())
+        if ((m_tabs.find(channel.get()) != m_tabs.end()) || (m_pending.find(channel.get()) != m_pending.end()))
         {
             Er::Log::error(m_params.log, "Connection {} already has a tab", endpoint);
             return;
         }
 
-        m_tabs.insert({ channel.get(), std::make_unique<Erp::ProcessMgr::ProcessTab>(m_params, channel, endpoint) });
+        if (!m_params.lazyActivation)
+        {
+            m_tabs.insert({ channel.get(), std::make_unique<Erp::ProcessMgr::ProcessTab>(m_params, channel, endpoint) });
+            return;
+        }
+
+        // the worker threads and the connection's clients wait until the tab is looked at
+        auto key = channel.get();
+        auto page = new Erc::Ui::LazyPage([this, key]() { activate(key); }, m_params.tabWidget);
+        m_pending.insert({ key, Pending{ channel, endpoint, page } });
+
+        m_params.tabWidget->addTab(page, Erp::ProcessMgr::ProcessTab::title(endpoint));
     }
 
     void removeConnection(Er::Client::ChannelPtr channel) noexcept override
     {
+        auto pending = m_pending.find(channel.get());
+        if (pending != m_pending.end())
+        {
+            removePage(pending->second.page);
+            m_pending.erase(pending);
+            return;
+        }
+
         auto it = m_tabs.find(channel.get());
         if (it == m_tabs.end())
         {
@@ -197,6 +219,60 @@ private slots:
     }
 
 private:
+    struct Pending
+    {
+        Er::Client::ChannelPtr channel;
+        std::string endpoint;
+        QWidget* page;
+    };
+
+    void activate(void* key)
+    {
+        auto it = m_pending.find(key);
+        if (it == m_pending.end())
+            return;
+
+        auto& pending = it->second;
+
+        Er::Log::debug(m_params.log, "Activating the process tab for {}", pending.endpoint);
+
+        auto activated = Er::protectedCall<bool>(
+            m_params.log,
+            [this, key, &pending]()
+            {
+                auto tab = std::make_unique<Erp::ProcessMgr::ProcessTab>(m_params, pending.channel, pending.endpoint, pending.page);
+
+                // the menu may have been used while the tab was waiting
+                if (!m_autoRefresh)
+                    tab->setAutoRefresh(false);
+                tab->setRefreshInterval(m_refreshInterval);
+
+                m_tabs.insert({ key, std::move(tab) });
+                return true;
+            });
+
+        if (!activated)
+        {
+            // the placeholder would never turn into a tab; we're inside its showEvent(), so it can't be deleted right away
+            auto index = m_params.tabWidget->indexOf(pending.page);
+            if (index >= 0)
+                m_params.tabWidget->removeTab(index);
+
+            pending.page->deleteLater();
+        }
+
+        m_pending.erase(it);
+    }
+
+    void removePage(QWidget* page) noexcept
+    {
+        auto index = m_params.tabWidget->indexOf(page);
+        if (index >= 0)
+            m_params.tabWidget->removeTab(index);
+
+        delete page;
+    }
+
     Erc::PluginParams m_params;
     bool m_autoRefresh;
     unsigned m_refreshInterval;
@@ -212,6 +288,7 @@ private:
     QAction* m_refresh5Action;
     QAction* m_refresh10Action;
     std::unordered_map<void*, std::unique_ptr<Erp::ProcessMgr::ProcessTab>> m_tabs; // connection -> tab
+    std::unordered_map<void*, Pending> m_pending; // connection -> placeholder tab not shown yet
 };
 
 } // namespace {}
@@ -19,8 +19,8 @@ public:
     {
     }
 
-    explicit ProcessStubImpl(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
-        : m_client(Er::Client::createClient(channel, log))
+    explicit ProcessStubImpl(std::shared_ptr<Er::Client::IClient> client, Er::Log::ILog* log)
+        : m_client(client)
         , m_log(log)
     {
     }
@@ -53,9 +53,9 @@ private:
 } // namespace {}
 
 
-std::unique_ptr<IProcessStub> createProcessStub(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
+std::unique_ptr<IProcessStub> createProcessStub(std::shared_ptr<Er::Client::IClient> client, Er::Log::ILog* log)
 {
-    return std::make_unique<ProcessStubImpl>(channel, log);
+    return std::make_unique<ProcessStubImpl>(client, log);
 }
 
 } // namespace Erp::ProcessMgr {}
@@ -15,6 +15,6 @@ struct IProcessStub
 };
 
 
-std::unique_ptr<IProcessStub> createProcessStub(Er::Client::ChannelPtr channel, Er::Log::ILog* log);
+std::unique_ptr<IProcessStub> createProcessStub(std::shared_ptr<Er::Client::IClient> client, Er::Log::ILog* log);
 
 } // namespace Erp::ProcessMgr {}
@@ -1,7 +1,11 @@
 #include "processtab.hpp"
 
+#include <QEvent>
 #include <QGridLayout>
 #include <QHeaderView>
+#include <QScrollBar>
+
+#include <chrono>
 
 namespace Erp::ProcessMgr
 {
@@ -10,10 +14,11 @@ namespace Erp::ProcessMgr
 ProcessTab::~ProcessTab()
 {
     m_refreshTimer->stop();
+    m_visibleRowsTimer->stop();
     
     saveColumns();
 
-    m_processListWorker.destroy();
+    m_processListWorker->shutdown();
 
     delete m_contextMenu;
 
@@ -31,18 +36,21 @@ ProcessTab::~ProcessTab()
     delete m_widget;
 }
 
-ProcessTab::ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr channel, const std::string& endpoint)
+ProcessTab::ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr channel, const std::string& endpoint, QWidget* page)
     : QObject(params.tabWidget)
     , m_params(params)
     , m_autoRefresh(Erc::Option<bool>::get(params.settings, Erp::ProcessMgr::Settings::autoRefresh, true))
     , m_refreshRate(Erc::Option<unsigned>::get(params.settings, Erp::ProcessMgr::Settings::refreshRate, Erp::ProcessMgr::Settings::RefreshRateDefault))
+    , m_backgroundRefreshRate(Erc::Option<unsigned>::get(params.settings, Erp::ProcessMgr::Settings::backgroundRefreshRate, Erp::ProcessMgr::Settings::BackgroundRefreshRateDefault))
+    , m_phase(params.executor->phase())
     , m_trackDuration(Erc::Option<unsigned>::get(params.settings, Erp::ProcessMgr::Settings::trackDuration, Erp::ProcessMgr::Settings::TrackDurationDefault))
     , m_refreshTimer(new QTimer(this))
+    , m_visibleRowsTimer(new QTimer(this))
     , m_columns(loadProcessColumns(m_params.settings))
     , m_required(makePropMask(m_columns))
     , m_channel(channel)
     , m_endpoint(endpoint)
-    , m_widget(new QWidget(params.tabWidget))
+    , m_widget(page ? page : new QWidget(params.tabWidget))
     , m_treeView(new QTreeView(m_widget))
     , m_labelTotalProcesses(new QLabel(m_widget))
     , m_labelCpuUsage(new QLabel(m_widget))
@@ -63,8 +71,11 @@ ProcessTab::ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr c
 
     layout->addWidget(m_treeView, 0, 0, 1, 1);
 
-    params.tabWidget->addTab(m_widget, QString());
-    params.tabWidget->setTabText(params.tabWidget->indexOf(m_widget), tr("Processes"));
+    if (!page)
+    {
+        params.tabWidget->addTab(m_widget, QString());
+        params.tabWidget->setTabText(params.tabWidget->indexOf(m_widget), title(endpoint));
+    }
 
     params.statusBar->addWidget(m_labelTotalProcesses);
     params.statusBar->addWidget(m_labelCpuUsage);
@@ -77,9 +88,30 @@ ProcessTab::ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr c
     if (m_refreshRate < 500)
         m_refreshRate = 1000;
 
+    if ((m_backgroundRefreshRate > 0) && (m_backgroundRefreshRate < m_refreshRate))
+        m_backgroundRefreshRate = m_refreshRate;
+
     m_refreshTimer->setSingleShot(true);
     connect(m_refreshTimer, &QTimer::timeout, this, [this]() { refresh(false); });
-    m_refreshTimer->start(m_refreshRate);
+
+    // a lazily activated tab is being shown already, so there's no show event to wait for
+    m_visible = m_widget->isVisible();
+    m_widget->installEventFilter(this);
+
+    // the status bar is shared by the tabs of all hosts
+    m_labelTotalProcesses->setVisible(m_visible);
+    m_labelCpuUsage->setVisible(m_visible);
+
+    // tabs of different hosts take turns instead of all collecting at once
+    if (m_autoRefresh)
+        scheduleRefresh(true);
+
+    // icons for the rows being looked at are fetched first
+    m_visibleRowsTimer->setSingleShot(true);
+    connect(m_visibleRowsTimer, &QTimer::timeout, this, &ProcessTab::updateVisibleRows);
+    connect(m_treeView->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() { scheduleVisibleRowsUpdate(); });
+    connect(m_treeView, &QTreeView::expanded, this, [this]() { scheduleVisibleRowsUpdate(); });
+    connect(m_treeView, &QTreeView::collapsed, this, [this]() { scheduleVisibleRowsUpdate(); });
 }
 
 void ProcessTab::setAutoRefresh(bool autoRefresh)
@@ -89,10 +121,71 @@ void ProcessTab::setAutoRefresh(bool autoRefresh)
 
     m_refreshTimer->stop();
 
-    if (autoRefresh && !prev)
+    if (autoRefresh && !prev && !m_collecting)
+    {
+        scheduleRefresh();
+    }
+}
+
+void ProcessTab::scheduleRefresh(bool soon)
+{
+    auto rate = int64_t(m_visible ? m_refreshRate : m_backgroundRefreshRate);
+    if (!rate)
+        return;
+
+    // slots are counted on a clock shared by all tabs, each tab at its own offset into the period,
+    // so tabs keep taking turns however long their collections take
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto offset = int64_t(m_phase * double(rate));
+    auto delay = ((offset - now) % rate + rate) % rate;
+
+    // after a refresh, skip a slot that's too close so that the rate doesn't double
+    if (!soon && (delay < rate / 2))
+        delay += rate;
+
+    m_refreshTimer->start(int(delay));
+}
+
+bool ProcessTab::eventFilter(QObject* watched, QEvent* event)
+{
+    // also sent when another tab is selected or the window is minimized or hidden to the tray
+    if (watched == m_widget)
     {
-        m_refreshTimer->start(m_refreshRate);
+        if (event->type() == QEvent::Show)
+            setTabVisible(true);
+        else if (event->type() == QEvent::Hide)
+            setTabVisible(false);
     }
+
+    return QObject::eventFilter(watched, event);
+}
+
+void ProcessTab::setTabVisible(bool visible)
+{
+    if (visible == m_visible)
+        return;
+
+    m_visible = visible;
+
+    m_labelTotalProcesses->setVisible(visible);
+    m_labelCpuUsage->setVisible(visible);
+
+    Er::Log::debug(m_params.log, "Process tab for {} is {}", m_endpoint, visible ? "visible" : "hidden");
+
+    if (!m_autoRefresh || m_collecting)
+        return; // the refresh in flight reschedules at the right rate
+
+    m_refreshTimer->stop();
+
+    if (visible)
+        refresh(false); // catch up right away
+    else
+        scheduleRefresh();
+}
+
+QString ProcessTab::title(const std::string& endpoint)
+{
+    return tr("Processes @ %1").arg(Erc::fromUtf8(endpoint));
 }
 
 void ProcessTab::setRefreshInterval(unsigned interval)
@@ -129,20 +222,54 @@ void ProcessTab::reloadColumns()
 
 void ProcessTab::startWorker()
 {
-    m_processListWorker.make(m_channel, m_params.log);
+    IconCache::Params iconParams(
+        Erc::Option<unsigned>::get(m_params.settings, Erp::ProcessMgr::Settings::iconMaxInFlight, Erp::ProcessMgr::Settings::IconMaxInFlightDefault)
+    );
+
+    m_processListWorker = new ProcessListWorker(m_channel, m_params.executor, m_params.log, iconParams, this);
 
     // know when worker has data
-    connect(m_processListWorker.worker.get(), SIGNAL(dataReady(ProcessChangesetPtr,bool)), this, SLOT(dataReady(ProcessChangesetPtr,bool)));
-    connect(m_processListWorker.worker.get(), SIGNAL(posixResult(Erp::ProcessMgr::PosixResult)), this, SLOT(posixResult(Erp::ProcessMgr::PosixResult)));
+    connect(m_processListWorker, SIGNAL(dataReady(ProcessChangesetPtr,bool)), this, SLOT(dataReady(ProcessChangesetPtr,bool)));
+    connect(m_processListWorker, SIGNAL(collectFailed(bool)), this, SLOT(collectFailed(bool)));
+    connect(m_processListWorker, SIGNAL(posixResult(Erp::ProcessMgr::PosixResult)), this, SLOT(posixResult(Erp::ProcessMgr::PosixResult)));
+}
 
-    m_processListWorker.start();
+void ProcessTab::scheduleVisibleRowsUpdate()
+{
+    // coalesce bursts of scroll events
+    if (!m_visibleRowsTimer->isActive())
+        m_visibleRowsTimer->start(VisibleRowsUpdateDelay);
+}
+
+void ProcessTab::updateVisibleRows()
+{
+    if (!m_model)
+        return;
+
+    std::vector<uint64_t> visible;
+
+    auto viewportHeight = m_treeView->viewport()->height();
+    auto index = m_treeView->indexAt(QPoint(0, 0));
+    while (index.isValid())
+    {
+        if (m_treeView->visualRect(index).top() >= viewportHeight)
+            break;
+
+        visible.push_back(m_model->pid(index));
+        index = m_treeView->indexBelow(index);
+    }
+
+    m_processListWorker->prioritizeIcons(visible);
 }
 
 void ProcessTab::refresh(bool manual)
 {
     Er::Log::debug(m_params.log, "Refreshing...");
 
-    m_processListWorker.refresh(manual, m_required, m_trackDuration);
+    if (!manual)
+        m_collecting = true;
+
+    m_processListWorker->refresh(m_required, m_trackDuration, manual);
 }
 
 void ProcessTab::dataReady(ProcessChangesetPtr changeset, bool manual)
@@ -160,6 +287,7 @@ void ProcessTab::dataReady(ProcessChangesetPtr changeset, bool manual)
                 m_contextMenu->setModel(m_model);
 
                 restoreColumnWidths();
+                scheduleVisibleRowsUpdate();
             }
             else
             {
@@ -177,6 +305,9 @@ void ProcessTab::dataReady(ProcessChangesetPtr changeset, bool manual)
                 {
                     m_treeView->expandRecursively(index);
                 }
+
+                if (!parentsToExpand.empty() || !changeset->purged.empty())
+                    scheduleVisibleRowsUpdate();
             }
 
             m_labelTotalProcesses->setText(tr("Processes: ") + QString::number(changeset->totalProcesses));
@@ -197,10 +328,24 @@ void ProcessTab::dataReady(ProcessChangesetPtr changeset, bool manual)
         }
     );
 
-    if (!manual && m_autoRefresh)
+    refreshDone(manual);
+}
+
+void ProcessTab::collectFailed(bool manual)
+{
+    // already logged by the worker; try again at the next tick
+    refreshDone(manual);
+}
+
+void ProcessTab::refreshDone(bool manual)
+{
+    if (!manual)
     {
+        m_collecting = false;
+
         // schedule the next refresh
-        m_refreshTimer->start(m_refreshRate);
+        if (m_autoRefresh)
+            scheduleRefresh();
     }
 }
 
@@ -228,7 +373,7 @@ void ProcessTab::kill(quint64 pid, QLatin1String signal)
 {
     Er::Log::debug(m_params.log, "Kill({}, {})", pid, signal.data());
 
-    m_processListWorker.kill(pid, signal);
+    m_processListWorker->kill(pid, signal);
 }
 
 void ProcessTab::posixResult(Erp::ProcessMgr::PosixResult result)
@@ -10,7 +10,6 @@
 #include <QPointer>
 #include <QTimer>
 #include <QTreeView>
-#include <QThread>
 #include <QWidget>
 
 namespace Erp::ProcessMgr
@@ -23,32 +22,52 @@ class ProcessTab final
 
 public:
     ~ProcessTab();
-    explicit ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr channel, const std::string& endpoint);
+    // 'page' is a tab already in the tab widget to fill in; a new tab is added if there's none
+    explicit ProcessTab(const Erc::PluginParams& params, Er::Client::ChannelPtr channel, const std::string& endpoint, QWidget* page = nullptr);
 
     void saveColumns();
     void reloadColumns();
     void setRefreshInterval(unsigned interval);
     void setAutoRefresh(bool autoRefresh);
 
+    // the process tabs of several hosts may be open at once
+    static QString title(const std::string& endpoint);
+
 public slots:
     void refresh(bool manual);
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private slots:
     void dataReady(ProcessChangesetPtr changeset, bool manual);
+    void collectFailed(bool manual);
     void kill(quint64 pid, QLatin1String signal);
     void posixResult(Erp::ProcessMgr::PosixResult);
+    void updateVisibleRows();
         
 private:
     void captureColumnWidths();
     void restoreColumnWidths();
     void startWorker();
+    void scheduleVisibleRowsUpdate();
+    void scheduleRefresh(bool soon = false); // 'soon' takes the very next slot, however close
+    void refreshDone(bool manual);
+    void setTabVisible(bool visible);
     static void requireAdditionalProps(Er::ProcessMgr::ProcessProps::PropMask& required) noexcept;
 
+    static constexpr int VisibleRowsUpdateDelay = 100; // msec
+
     Erc::PluginParams m_params;
     bool m_autoRefresh;
     unsigned m_refreshRate; // msec
+    unsigned m_backgroundRefreshRate; // msec; 0 means no refreshes while hidden
+    bool m_visible = false;
+    bool m_collecting = false; // an automatic refresh is in flight
+    double m_phase; // where in every period this tab refreshes, as a fraction of it
     unsigned m_trackDuration;
     QTimer* m_refreshTimer;
+    QTimer* m_visibleRowsTimer;
     ProcessColumns m_columns;
     bool m_columnsChanged = false;
     Er::ProcessMgr::ProcessProps::PropMask m_required;
@@ -56,7 +75,7 @@ private:
     std::string m_endpoint;
     QWidget* m_widget;
     QTreeView* m_treeView;
-    ProcessListThread m_processListWorker;
+    ProcessListWorker* m_processListWorker = nullptr;
     ProcessTreeModel* m_model = nullptr;
     QLabel* m_labelTotalProcesses;
     QLabel* m_labelCpuUsage;
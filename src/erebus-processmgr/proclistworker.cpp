@@ -2,6 +2,8 @@
 
 #include <erebus/util/exceptionutil.hxx>
 
+#include <algorithm>
+
 
 namespace Erp::ProcessMgr
 {
@@ -9,45 +11,71 @@ namespace Erp::ProcessMgr
 
 ProcessListWorker::~ProcessListWorker()
 {
+    shutdown();
 }
 
-ProcessListWorker::ProcessListWorker(Er::Client::ChannelPtr channel, Er::Log::ILog* log, QObject* parent)
+ProcessListWorker::ProcessListWorker(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const IconCache::Params& iconParams, QObject* parent)
     : QObject(parent)
     , m_log(log)
-    , m_processList(createProcessList(channel, log))
-    , m_processStub(createProcessStub(channel, log))
+    , m_limiter(executor, std::max(executor->concurrency() / 2, 2U)) // the collector and at least one more
+    , m_processList(createProcessList(channel, &m_limiter, log, iconParams))
+    , m_processStub(createProcessStub(Er::Client::createClient(channel, log), log))
+    , m_collector(&m_limiter)
+    , m_control(&m_limiter)
 {
 }
 
 void ProcessListWorker::shutdown()
 {
+    m_collector.close();
+    m_control.close();
+
     m_processList.reset();
 }
 
+void ProcessListWorker::prioritizeIcons(const std::vector<uint64_t>& visible) noexcept
+{
+    if (m_processList)
+        m_processList->prioritizeIcons(visible);
+}
+
 void ProcessListWorker::refresh(Er::ProcessMgr::ProcessProps::PropMask required, int trackDuration, bool manual)
 {
-    Er::protectedCall<void>(
-        m_log,
+    m_collector.post(
         [this, required, trackDuration, manual]()
         {
-            auto changeset = m_processList->collect(required, std::chrono::milliseconds(trackDuration));
+            auto collected = Er::protectedCall<bool>(
+                m_log,
+                [this, required, trackDuration, manual]()
+                {
+                    auto changeset = m_processList->collect(required, std::chrono::milliseconds(trackDuration));
+
+                    emit dataReady(changeset, manual);
+                    return true;
+                }
+            );
 
-            emit dataReady(changeset, manual);
-        }
-    );
+            // the tab waits for an answer before scheduling the next refresh
+            if (!collected)
+                emit collectFailed(manual);
+        });
 }
 
 void ProcessListWorker::kill(quint64 pid, QLatin1String signame)
 {
-    Er::protectedCall<void>(
-        m_log,
-        [this, pid, signame]()
+    m_control.post(
+        [this, pid, signame = std::string(signame.data(), signame.size())]()
         {
-            auto result = m_processStub->kill(pid, std::string_view(signame.data(), signame.length()));
+            Er::protectedCall<void>(
+                m_log,
+                [this, pid, &signame]()
+                {
+                    auto result = m_processStub->kill(pid, signame);
 
-            emit posixResult(result);
-        }
-    );
+                    emit posixResult(result);
+                }
+            );
+        });
 }
 
 
@@ -3,9 +3,9 @@
 #include "processlist.hpp"
 #include "processstub.hpp"
 
+#include <erebus-gui/executor.hpp>
+
 #include <QObject>
-#include <QPointer>
-#include <QThread>
 
 
 namespace Erp::ProcessMgr
@@ -14,6 +14,11 @@ namespace Erp::ProcessMgr
 using ProcessChangesetPtr = std::shared_ptr<Erp::ProcessMgr::IProcessList::Changeset>;
 
 
+//
+// lives on the GUI thread; the requests run on the shared executor, at most
+// half of it per connection, and the results come back as (queued) signals
+//
+
 class ProcessListWorker final
     : public QObject
 {
@@ -21,84 +26,27 @@ class ProcessListWorker final
 
 public:
     ~ProcessListWorker();
-    explicit ProcessListWorker(Er::Client::ChannelPtr channel, Er::Log::ILog* log, QObject* parent);
+    explicit ProcessListWorker(Er::Client::ChannelPtr channel, Erc::IExecutor* executor, Er::Log::ILog* log, const IconCache::Params& iconParams, QObject* parent);
 
+    // drops the requests that haven't started and waits for the ones that have
     void shutdown();
+    void prioritizeIcons(const std::vector<uint64_t>& visible) noexcept;
 
-public slots:
     void refresh(Er::ProcessMgr::ProcessProps::PropMask required, int trackDuration, bool manual);
     void kill(quint64 pid, QLatin1String signame);
 
 signals:
     void dataReady(ProcessChangesetPtr, bool);
+    void collectFailed(bool); // every refresh() ends with either this or dataReady()
     void posixResult(Erp::ProcessMgr::PosixResult);
 
 private:
     Er::Log::ILog* m_log;
-    std::unique_ptr<IProcessList> m_processList;
-    std::unique_ptr<IProcessStub> m_processStub;
-};
-
-
-struct ProcessListThread final
-    : public Er::NonCopyable
-{
-    QPointer<QThread> thread;
-    QPointer<ProcessListWorker> worker;
-
-    void destroy()
-    {
-        if (worker)
-        {
-            worker->shutdown();
-            worker.clear();
-        }
-
-        if (thread)
-        {
-            thread->quit();
-            thread->wait();
-            thread.clear();
-        }
-    }
-
-    void make(Er::Client::ChannelPtr channel, Er::Log::ILog* log)
-    {
-        thread = new QThread(nullptr);
-        worker = new ProcessListWorker(channel, log, nullptr);
-
-        // auto-delete thread
-        QObject::connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-
-        // auto-delete worker
-        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
-        worker->moveToThread(thread);
-    }
-
-    void start()
-    {
-        if (thread)
-        {
-            thread->start();
-            thread->setObjectName("ProcessList");
-        }
-    }
-
-    void refresh(bool manual, Er::ProcessMgr::ProcessProps::PropMask required, int trackDuration)
-    {
-        if (worker)
-        {
-            QMetaObject::invokeMethod(worker, "refresh", Qt::AutoConnection, Q_ARG(Er::ProcessMgr::ProcessProps::PropMask, required), Q_ARG(int, trackDuration), Q_ARG(bool, manual));
-        }
-    }
-
-    void kill(quint64 pid, QLatin1String signal)
-    {
-        if (worker)
-        {
-            QMetaObject::invokeMethod(worker, "kill", Qt::AutoConnection, Q_ARG(quint64, pid), Q_ARG(QLatin1String, signal));
-        }
-    }
+    Erc::Limiter m_limiter; // everything below runs through it; destroyed last
+    std::unique_ptr<IProcessList> m_processList; // a client for the collector and one per icon fetch in flight
+    std::unique_ptr<IProcessStub> m_processStub; // a client for the control strand
+    Erc::Strand m_collector; // collect() isn't reentrant
+    Erc::Strand m_control;   // so that a kill doesn't wait for a collect
 };
 
 } // namespace Erp::ProcessMgr {}
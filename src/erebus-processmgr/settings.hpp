@@ -18,9 +18,15 @@ constexpr std::string_view autoRefresh("processtab/auto_refresh");
 constexpr std::string_view refreshRate("processtab/refresh_rate");
 constexpr unsigned RefreshRateDefault = 1000; // 1 sec
 
+constexpr std::string_view backgroundRefreshRate("processtab/background_refresh_rate"); // while the tab isn't visible
+constexpr unsigned BackgroundRefreshRateDefault = 0; // paused
+
 constexpr std::string_view trackDuration("processtab/track_duration");
 constexpr unsigned TrackDurationDefault = 5000; // 5 sec
 
+constexpr std::string_view iconMaxInFlight("processtab/icon_max_in_flight");
+constexpr unsigned IconMaxInFlightDefault = 2; // per connection
+
 
 } // namespace Settings {}
 